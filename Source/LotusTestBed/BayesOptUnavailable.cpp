@@ -0,0 +1,41 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "BayesOptimizer.hpp"
+
+#if !WITH_BAYESOPT
+
+/*
+	BayesOpt is only prebuilt for Windows. On other platforms the module still has to
+	link, e.g. for the headless benchmark commandlet, so the C API used by BayesOptimizer
+	is defined here as no-ops. BayesOptimizer::IsAvailable() is false and the engine
+	refuses to start a Bayesian optimization, so none of these are expected to be called.
+*/
+
+extern "C"
+{
+	bopt_params initialize_parameters_to_default(void)
+	{
+		bopt_params params;
+		FMemory::Memzero(params);
+		return params;
+	}
+
+	void set_kernel(bopt_params* params, const char* name) {}
+	void set_mean(bopt_params* params, const char* name) {}
+	void set_criteria(bopt_params* params, const char* name) {}
+	void set_surrogate(bopt_params* params, const char* name) {}
+
+	void createOptimizer(void*& handle, bopt_params parameters, int numDims, const double* lb, const double* ub) { handle = nullptr; }
+	void releaseOptimizer(void*& handle) { handle = nullptr; }
+	void initOptimizerContinuous(void* handle, const double* const* X, const double* y, int numPoints) {}
+	void generateLHSamples(void* handle, double** X, int numSamples, int numDims) {}
+	void argMin(void* handle, double* x) {}
+	void minValue(void* handle, double* x) { *x = 0.0; }
+	bool OptAcquisition(void* handle, double* x) { return true; }
+	void updateOptimizer(void* handle, const double* xi, const double y) {}
+	void getDistribution(void* handle, const double* xi, double* mu, double* std) { *mu = 0.0; *std = 0.0; }
+	int viewLog(void* handle, const char*& log) { log = ""; return 0; }
+	void attachLog(void* handle) {}
+}
+
+#endif
@@ -1,8 +1,15 @@
 #include "BayesOptimizer.hpp"
 
 #include "Core.h"
+#include "Async/Async.h"
 #include <assert.h>
 
+// Trust region schedule of TuRBO (Eriksson et al. 2019), edge lengths in the unit hypercube
+constexpr double TRUST_LENGTH_INIT = 0.8;
+constexpr double TRUST_LENGTH_MIN = 0.0078125; // 0.5^7
+constexpr double TRUST_LENGTH_MAX = 1.6;
+constexpr int TRUST_SUCCESS_TOLERANCE = 3;
+
 BayesOptimizer::BayesOptimizer()
 {
 	FString basePath = FPaths::Combine(FPaths::ProjectDir(),
@@ -16,6 +23,8 @@ BayesOptimizer::BayesOptimizer()
 
 BayesOptimizer::~BayesOptimizer()
 {
+	this->WaitForAsync();
+
 	if (this->LibraryHandle)
 	{
 		FPlatformProcess::FreeDllHandle(this->LibraryHandle);
@@ -23,6 +32,7 @@ BayesOptimizer::~BayesOptimizer()
 	}
 
 	releaseOptimizer(this->Model);
+	if (this->LocalModel) releaseOptimizer(this->LocalModel);
 }
 
 void BayesOptimizer::SetTrainIterations(int NumSamples)
@@ -76,8 +86,13 @@ void BayesOptimizer::SetCriteriaMethod(const FName& Method)
 		set_criteria(&ModelParams, "cHedge(cEI, cPOI, cMI, cLCB)");
 	else if (Method == methods[8])
 		set_criteria(&ModelParams, "cHedge(cEI, cPOI, cMI, cLCB, cAopt, cExpReturn, cOptimisticSampling, cThompsonSampling)");
+	else if (Method == methods[9])
+		set_criteria(&ModelParams, "cEI");
 	else
 		set_criteria(&ModelParams, "cLCB");
+
+	// The local models of the trust region maximize EI
+	this->UseTrustRegion = Method == methods[9];
 }
 
 void BayesOptimizer::SetForceJumpStepIters(int Iters)
@@ -150,6 +165,21 @@ void BayesOptimizer::SetSurrogateMethod(const FName& Method)
 		set_surrogate(&ModelParams, "sGaussianProcessML");
 }
 
+void BayesOptimizer::SetInitialDesign(const FName& Method)
+{
+	if (Method == "Sobol")
+		ModelParams.init_method = 2;
+	else if (Method == "Maximin Latin Hypercube")
+		ModelParams.init_method = 4;
+	else
+		ModelParams.init_method = 1;
+}
+
+void BayesOptimizer::SetInitialDesignBudget(float Seconds)
+{
+	this->InitialDesignBudget = Seconds;
+}
+
 void BayesOptimizer::SetLearnAll(bool Value)
 {
 	ModelParams.l_all = Value;
@@ -167,6 +197,9 @@ void BayesOptimizer::SetupInternalParameters(bopt_params& Params)
 
 void BayesOptimizer::LoadDLL()
 {
+	this->LibraryHandle = nullptr;
+	if (!BayesOptimizer::IsAvailable()) return;
+
 	this->LibraryHandle = !this->PathToDLL.IsEmpty() ?
 		FPlatformProcess::GetDllHandle(*PathToDLL) : nullptr;
 
@@ -193,6 +226,23 @@ double BayesOptimizer::ReFitModel(TArray<double>& X, double Y)
 	return end - start;
 }
 
+double BayesOptimizer::ReFitModelBatch(TArray<TArray<double>>& X, const TArray<double>& Y)
+{
+	// The model only holds real observations (fantasies live in a believer
+	// model of GetNextSteps), so the batch is a sequence of incremental updates.
+	double elapsed_time = 0;
+	for (int sample_i = 0; sample_i < X.Num(); ++sample_i)
+	{
+		elapsed_time += this->ReFitModel(X[sample_i], Y[sample_i]);
+	}
+
+	if (this->UseTrustRegion)
+	{
+		this->UpdateTrustRegion(X, Y);
+	}
+	return elapsed_time;
+}
+
 void BayesOptimizer::GetArgMin(TArray<double>& X)
 {
 	X.SetNum(this->NumDims);
@@ -211,10 +261,15 @@ void BayesOptimizer::GetOptimum(TArray<double>& X, double* Y)
 }
 
 double BayesOptimizer::GetNextStep(TArray<double>& X)
+{
+	return this->GetNextStep(this->Model, X);
+}
+
+double BayesOptimizer::GetNextStep(void* Handle, TArray<double>& X)
 {
 	X.SetNum(this->NumDims);
 	double start = FPlatformTime::Seconds() * 1000;
-	const bool err = OptAcquisition(this->Model, X.GetData());
+	const bool err = OptAcquisition(Handle, X.GetData());
 	double end = FPlatformTime::Seconds() * 1000;
 
 	if (err) { UE_LOG(LogTemp, Error,
@@ -223,6 +278,102 @@ double BayesOptimizer::GetNextStep(TArray<double>& X)
 	return end - start;
 }
 
+double BayesOptimizer::GetNextSteps(int BatchSize, TArray<TArray<double>>& X,
+	const TArray<TArray<double>>& Pending)
+{
+	X.SetNum(BatchSize);
+	double start = FPlatformTime::Seconds() * 1000;
+
+	// The candidates come from a model of the trust region, when it holds enough samples.
+	// The global model only tracks the real observations, for the optimum and the
+	// response surface.
+	TArray<double> Low, Scale;
+	if (this->UseTrustRegion && this->Dataset.Num() > 0 && this->FitLocalModel(Low, Scale))
+	{
+		TArray<TArray<double>> LocalPending;
+		for (const TArray<double>& Point : Pending)
+		{
+			TArray<double> Local;
+			if (this->ToLocal(Point, Local)) LocalPending.Add(MoveTemp(Local));
+		}
+
+		this->GetNextSteps(this->LocalModel, this->LocalDataset, BatchSize, X, LocalPending);
+
+		for (TArray<double>& Sample : X)
+		{
+			for (int dim_i = 0; dim_i < this->NumDims; ++dim_i)
+			{
+				Sample[dim_i] = FMath::Clamp(Low[dim_i] + Sample[dim_i] * Scale[dim_i], 0., 1.);
+			}
+		}
+	}
+	else
+	{
+		this->GetNextSteps(this->Model, this->Dataset, BatchSize, X, Pending);
+	}
+
+	double end = FPlatformTime::Seconds() * 1000;
+	return end - start;
+}
+
+void BayesOptimizer::GetNextSteps(void* Handle, const TDataset& Data, int BatchSize,
+	TArray<TArray<double>>& X, const TArray<TArray<double>>& Pending)
+{
+	if (Pending.Num() == 0 && BatchSize == 1)
+	{
+		this->GetNextStep(Handle, X[0]);
+		return;
+	}
+
+	// Points under evaluation take their predicted mean as observation
+	// (kriging believer), so the candidates look elsewhere.
+	void* Believer = nullptr;
+	this->FitBelieverModel(Believer, Data, Pending);
+
+	for (int batch_i = 0; batch_i < BatchSize; ++batch_i)
+	{
+		this->GetNextStep(Believer, X[batch_i]);
+		if (batch_i + 1 < BatchSize)
+		{
+			this->AddFantasy(Believer, X[batch_i]);
+		}
+	}
+
+	releaseOptimizer(Believer);
+}
+
+void BayesOptimizer::BeginNextStepsAsync(int BatchSize, const TArray<TArray<double>>& NewX,
+	const TArray<double>& NewY, const TArray<TArray<double>>& Pending)
+{
+	this->WaitForAsync();
+
+	this->AsyncSteps = Async(EAsyncExecution::ThreadPool,
+		[this, BatchSize, NewX, NewY, Pending]() mutable
+		{
+			double elapsed_time = 0;
+			if (NewX.Num() > 0)
+			{
+				elapsed_time += this->ReFitModelBatch(NewX, NewY);
+			}
+			return elapsed_time + this->GetNextSteps(BatchSize, this->AsyncCandidates, Pending);
+		});
+}
+
+double BayesOptimizer::EndNextStepsAsync(TArray<TArray<double>>& X)
+{
+	if (!this->AsyncSteps.IsValid()) return 0;
+
+	const double elapsed_time = this->AsyncSteps.Get();
+	this->AsyncSteps.Reset();
+	X = MoveTemp(this->AsyncCandidates);
+	return elapsed_time;
+}
+
+void BayesOptimizer::WaitForAsync()
+{
+	if (this->AsyncSteps.IsValid()) this->AsyncSteps.Wait();
+}
+
 void BayesOptimizer::GetTrainStep(TArray<double>& X, int SampleIdx)
 {
 	X = this->UniformSamples[SampleIdx];
@@ -233,12 +384,8 @@ void BayesOptimizer::AddSample(const TArray<double>& X, const double Y)
 	this->Dataset.Add({ X, Y });
 }
 
-void BayesOptimizer::InitOptimizer(const int InNumDims)
+void BayesOptimizer::CreateModel(void*& Handle, const bopt_params& Params) const
 {
-	releaseOptimizer(this->Model);
-
-	this->SetupInternalParameters(this->ModelParams);
-	this->NumDims = InNumDims;
 	double low[128], up[128];
 
 	for (int i = 0; i < this->NumDims; ++i)
@@ -247,28 +394,76 @@ void BayesOptimizer::InitOptimizer(const int InNumDims)
 		up[i] = 1.;
 	}
 
-	createOptimizer(this->Model, this->ModelParams, this->NumDims, low, up);
+	createOptimizer(Handle, Params, this->NumDims, low, up);
+}
 
-	double** X = new double* [this->UniformSamples.Num()];
-	for (int sample_i = 0; sample_i < this->UniformSamples.Num(); ++sample_i)
+void BayesOptimizer::FitBelieverModel(void*& Handle, const TDataset& Data,
+	const TArray<TArray<double>>& Pending) const
+{
+	// Kriging believer: a second model of the same data takes its own predictions
+	// as observations, so the candidates look elsewhere. The C API cannot remove
+	// samples, and the real model keeps its incremental updates and relearn schedule.
+	// The kernel is learnt on the real data only.
+	bopt_params Params = this->ModelParams;
+	Params.n_iter_relearn = 0;
+	this->CreateModel(Handle, Params);
+	this->FitDataset(Handle, Data);
+
+	for (const TArray<double>& Point : Pending)
 	{
-		X[sample_i] = new double[this->NumDims];
-		this->UniformSamples[sample_i].SetNum(this->NumDims);
+		this->AddFantasy(Handle, Point);
 	}
+}
 
-	generateLHSamples(this->Model, X, this->UniformSamples.Num(), this->NumDims);
+void BayesOptimizer::AddFantasy(void* Handle, const TArray<double>& X) const
+{
+	double Mu = 0;
+	double Std = 0;
+	getDistribution(Handle, X.GetData(), &Mu, &Std);
+	updateOptimizer(Handle, X.GetData(), Mu);
+}
 
-	for (int sample_i = 0; sample_i < this->UniformSamples.Num(); ++sample_i)
-	{
-		memcpy_s(this->UniformSamples[sample_i].GetData(),
-			this->NumDims * sizeof(double),
-			X[sample_i],
-			this->NumDims * sizeof(double));
+void BayesOptimizer::InitOptimizer(const int InNumDims)
+{
+	// Candidates of a previous run are discarded
+	this->WaitForAsync();
+	this->AsyncSteps.Reset();
+	this->AsyncCandidates.Empty();
+	releaseOptimizer(this->Model);
 
-		delete[] X[sample_i];
+	this->SetupInternalParameters(this->ModelParams);
+	this->NumDims = InNumDims;
+	this->CreateModel(this->Model, this->ModelParams);
+	this->ResetTrustRegion();
+	if (this->LocalModel) releaseOptimizer(this->LocalModel);
+	this->LocalModel = nullptr;
+
+	// The design is written straight into the storage of the samples
+	const int NumSamples = this->UniformSamples.Num();
+	TArray<double*> Rows;
+	Rows.SetNum(NumSamples);
+	for (int sample_i = 0; sample_i < NumSamples; ++sample_i)
+	{
+		this->UniformSamples[sample_i].SetNum(this->NumDims);
+		Rows[sample_i] = this->UniformSamples[sample_i].GetData();
 	}
 
-	delete[] X;
+	if (this->ModelParams.init_method == 2)
+	{
+		// Restarts with the same dimensions, samples and seed reuse the design
+		bayesopt::utils::SobolDesignCache::instance().copyTo(Rows.GetData(),
+			NumSamples, this->NumDims, static_cast<uint32_t>(this->ModelParams.random_seed));
+	}
+	else if (this->ModelParams.init_method == 4)
+	{
+		// Every training sample is a full render: spend some time on its coverage
+		bayesopt::utils::maximinLhsGenerate(Rows.GetData(), NumSamples, this->NumDims,
+			static_cast<uint32_t>(this->ModelParams.random_seed), this->InitialDesignBudget);
+	}
+	else
+	{
+		generateLHSamples(this->Model, Rows.GetData(), NumSamples, this->NumDims);
+	}
 
 	//attachLog(this->Model);
 	this->Dataset.Empty();
@@ -282,36 +477,29 @@ double BayesOptimizer::FitModel()
 		return 0;
 	}
 
-	//Unoptimized but safe
+	return this->FitDataset(this->Model, this->Dataset);
+}
 
-	double** X = new double*[this->Dataset.Num()];
-	double* Y = new double[this->Dataset.Num()];
+double BayesOptimizer::FitDataset(void* Handle, const TDataset& Data) const
+{
+	TArray<const double*> X;
+	TArray<double> Y;
+	X.SetNum(Data.Num());
+	Y.SetNum(Data.Num());
 
-	for (int sample_i = 0; sample_i < this->Dataset.Num(); ++sample_i)
+	for (int sample_i = 0; sample_i < Data.Num(); ++sample_i)
 	{
-		const TDataPoint& sample = this->Dataset[sample_i];
-		Y[sample_i] = sample.Value;
-		X[sample_i] = new double[this->NumDims];
-		memcpy_s(
-			X[sample_i], sizeof(double) * this->NumDims,
-			sample.Key.GetData(), sizeof(double) * this->NumDims);
+		X[sample_i] = Data[sample_i].Key.GetData();
+		Y[sample_i] = Data[sample_i].Value;
 	}
 
 	double start = FPlatformTime::Seconds() * 1000;
-	initOptimizerContinuous(this->Model, X, Y, this->Dataset.Num());
+	initOptimizerContinuous(Handle, X.GetData(), Y.GetData(), Data.Num());
 	double end = FPlatformTime::Seconds() * 1000;
 
 	//const char* log = nullptr;
 	//int logSize = viewLog(this->Model, log);
 
-	for (int sample_i = 0; sample_i < this->Dataset.Num(); ++sample_i)
-	{
-		delete[] X[sample_i];
-	}
-
-	delete[] X;
-	delete[] Y;
-
 	return end - start;
 }
 
@@ -323,8 +511,180 @@ void BayesOptimizer::GetResponseSurfaceAt(const TArray<double>& X, double* Y)
 	*Y = Mu;
 }
 
+void BayesOptimizer::GetResponseSurfaceBatch(const TArray<double>& X, TArray<double>& Y)
+{
+	// X holds one point of NumDims coordinates after the other
+	const int NumPoints = X.Num() / this->NumDims;
+	Y.SetNum(NumPoints);
+	for (int i = 0; i < NumPoints; ++i)
+	{
+		double Std = 0;
+		getDistribution(this->Model, X.GetData() + i * this->NumDims, &Y[i], &Std);
+	}
+}
+
 void BayesOptimizer::RestartModel()
 {
 	this->InitOptimizer(this->NumDims);
 	this->FitModel();
-}
\ No newline at end of file
+}
+
+void BayesOptimizer::Serialize(FArchive& Ar)
+{
+	this->WaitForAsync();
+
+	// The model itself is not stored. After loading, FitModel rebuilds
+	// it (and relearns the kernel hyperparameters) from the dataset.
+	Ar << this->NumDims;
+	Ar << this->Dataset;
+	Ar << this->UniformSamples;
+
+	Ar << this->TrustCenter;
+	Ar << this->TrustBest;
+	Ar << this->TrustLength;
+	Ar << this->TrustSuccesses;
+	Ar << this->TrustFailures;
+}
+
+void BayesOptimizer::ResetTrustRegion()
+{
+	// An empty center is replaced by the incumbent when the local model is fitted
+	this->TrustCenter.Empty();
+	this->TrustBest = 0;
+	this->TrustLength = TRUST_LENGTH_INIT;
+	this->TrustSuccesses = 0;
+	this->TrustFailures = 0;
+}
+
+void BayesOptimizer::UpdateTrustRegion(const TArray<TArray<double>>& X, const TArray<double>& Y)
+{
+	int best_i = INDEX_NONE;
+	for (int sample_i = 0; sample_i < Y.Num(); ++sample_i)
+	{
+		if (best_i == INDEX_NONE || Y[sample_i] < Y[best_i]) best_i = sample_i;
+	}
+	if (best_i == INDEX_NONE || this->TrustCenter.Num() == 0) return;
+
+	// A batch succeeds when it improves the incumbent of the region by a relative margin
+	const int fail_tolerance = FMath::CeilToInt(FMath::Max(4., double(this->NumDims)) / Y.Num());
+	if (Y[best_i] < this->TrustBest - 1e-3 * FMath::Abs(this->TrustBest))
+	{
+		++this->TrustSuccesses;
+		this->TrustFailures = 0;
+	}
+	else
+	{
+		++this->TrustFailures;
+		this->TrustSuccesses = 0;
+	}
+
+	if (Y[best_i] < this->TrustBest)
+	{
+		this->TrustCenter = X[best_i];
+		this->TrustBest = Y[best_i];
+	}
+
+	if (this->TrustSuccesses == TRUST_SUCCESS_TOLERANCE)
+	{
+		this->TrustLength = FMath::Min(2. * this->TrustLength, TRUST_LENGTH_MAX);
+		this->TrustSuccesses = 0;
+	}
+	else if (this->TrustFailures >= fail_tolerance)
+	{
+		this->TrustLength /= 2.;
+		this->TrustFailures = 0;
+	}
+
+	if (this->TrustLength < TRUST_LENGTH_MIN)
+	{
+		// The region collapsed. The next one starts at the maximum of the global acquisition
+		this->ResetTrustRegion();
+		TArray<double> Restart;
+		Restart.SetNum(this->NumDims);
+		if (!OptAcquisition(this->Model, Restart.GetData()))
+		{
+			// The center is not observed yet. The first batch of the region has to
+			// beat the prediction there to count as a success.
+			double Mu = 0;
+			double Std = 0;
+			getDistribution(this->Model, Restart.GetData(), &Mu, &Std);
+			this->TrustCenter = Restart;
+			this->TrustBest = Mu;
+		}
+	}
+}
+
+bool BayesOptimizer::FitLocalModel(TArray<double>& Low, TArray<double>& Scale)
+{
+	if (this->TrustCenter.Num() != this->NumDims)
+	{
+		// Start from the incumbent
+		this->ResetTrustRegion();
+		for (const TDataPoint& sample : this->Dataset)
+		{
+			if (this->TrustCenter.Num() == 0 || sample.Value < this->TrustBest)
+			{
+				this->TrustCenter = sample.Key;
+				this->TrustBest = sample.Value;
+			}
+		}
+	}
+
+	Low.SetNum(this->NumDims);
+	Scale.SetNum(this->NumDims);
+	for (int dim_i = 0; dim_i < this->NumDims; ++dim_i)
+	{
+		const double low = FMath::Max(this->TrustCenter[dim_i] - 0.5 * this->TrustLength, 0.);
+		const double up = FMath::Min(this->TrustCenter[dim_i] + 0.5 * this->TrustLength, 1.);
+		Low[dim_i] = low;
+		Scale[dim_i] = FMath::Max(up - low, 1e-12);
+	}
+
+	// The local model is kept while the region does not move, and takes the new
+	// samples inside it incrementally
+	if (this->LocalModel && Low == this->LocalLow && Scale == this->LocalScale)
+	{
+		for (; this->LocalSynced < this->Dataset.Num(); ++this->LocalSynced)
+		{
+			TArray<double> Local;
+			if (this->ToLocal(this->Dataset[this->LocalSynced].Key, Local))
+			{
+				const double Y = this->Dataset[this->LocalSynced].Value;
+				updateOptimizer(this->LocalModel, Local.GetData(), Y);
+				this->LocalDataset.Add({ MoveTemp(Local), Y });
+			}
+		}
+		return true;
+	}
+
+	if (this->LocalModel) releaseOptimizer(this->LocalModel);
+	this->LocalModel = nullptr;
+	this->LocalLow = Low;
+	this->LocalScale = Scale;
+	this->LocalSynced = this->Dataset.Num();
+
+	this->LocalDataset.Empty();
+	for (const TDataPoint& sample : this->Dataset)
+	{
+		TArray<double> Local;
+		if (this->ToLocal(sample.Key, Local)) this->LocalDataset.Add({ MoveTemp(Local), sample.Value });
+	}
+
+	// The kernel cannot be learnt from fewer samples, the global model is used instead
+	if (this->LocalDataset.Num() < this->NumDims + 1) return false;
+
+	this->CreateModel(this->LocalModel, this->ModelParams);
+	this->FitDataset(this->LocalModel, this->LocalDataset);
+	return true;
+}
+
+bool BayesOptimizer::ToLocal(const TArray<double>& X, TArray<double>& Local) const
+{
+	Local.SetNum(this->NumDims);
+	for (int dim_i = 0; dim_i < this->NumDims; ++dim_i)
+	{
+		Local[dim_i] = (X[dim_i] - this->LocalLow[dim_i]) / this->LocalScale[dim_i];
+		if (Local[dim_i] < 0. || Local[dim_i] > 1.) return false;
+	}
+	return true;
+}
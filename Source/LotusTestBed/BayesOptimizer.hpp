@@ -6,11 +6,12 @@ THIRD_PARTY_INCLUDES_START
 #undef check
 #undef TEXT
 
-#define USE_SOBOL
 #define BAYESOPT_DLL
 
-#include "bayesopt\parameters.h"
-#include "bayesopt\bayesopt.h"
+#include "bayesopt/parameters.h"
+#include "bayesopt/bayesopt.h"
+#include "sobol.hpp"
+#include "maximin.hpp"
 
 #pragma pop_macro("check")
 #pragma pop_macro("TEXT")
@@ -18,6 +19,7 @@ THIRD_PARTY_INCLUDES_END
 
 #include "Containers/Map.h"
 #include "Containers/Array.h"
+#include "Async/Future.h"
 
 class BayesOptimizer final
 {
@@ -28,17 +30,30 @@ public:
 
     void LoadDLL();
 
+    // False on platforms without the prebuilt BayesOpt library
+    static bool IsAvailable() { return WITH_BAYESOPT != 0; }
+
     double GetNextStep(TArray<double>& X);
+    double GetNextSteps(int BatchSize, TArray<TArray<double>>& X,
+        const TArray<TArray<double>>& Pending = TArray<TArray<double>>());
+    void BeginNextStepsAsync(int BatchSize, const TArray<TArray<double>>& NewX,
+        const TArray<double>& NewY, const TArray<TArray<double>>& Pending);
+    double EndNextStepsAsync(TArray<TArray<double>>& X);
+    bool IsAsyncPending() const { return this->AsyncSteps.IsValid(); }
+    void WaitForAsync();
     void GetTrainStep(TArray<double>& X, int SampleIdx);
     void GetArgMin(TArray<double>& X);
     void GetMinValue(double* Y);
     void GetOptimum(TArray<double>& X, double* Y);
     void GetResponseSurfaceAt(const TArray<double>& X, double* Y);
+    void GetResponseSurfaceBatch(const TArray<double>& X, TArray<double>& Y);
     void AddSample(const TArray<double>& X, const double Y);
     void InitOptimizer(const int NumDims);
     double FitModel();
     double ReFitModel(TArray<double>& X, double Y);
+    double ReFitModelBatch(TArray<TArray<double>>& X, const TArray<double>& Y);
     void RestartModel();
+    void Serialize(FArchive& Ar);
 
     void SetTrainIterations(int NumSamples);
     void SetIterations(int NumIters);
@@ -55,12 +70,17 @@ public:
     void SetKernelMethod(const FName& Method);
     void SetCriteriaMethod(const FName& Method);
     void SetSurrogateMethod(const FName& Method);
+    void SetInitialDesign(const FName& Method);
+    void SetInitialDesignBudget(float Seconds);
     void SetLearnAll(bool Value);
 
     static int GetDefualtTrainingIters() { return 10; }
     static int GetDefualtExploreIters() { return 15; }
     static int GetDefualtRelearnIters() { return 20; }
+    static float GetDefaultInitialDesignBudget() { return 1; }
     static int GetDefaultForceJumpStepIters() { return 0; }
+    static int GetDefaultBatchSize() { return 1; }
+    static bool GetDefaultAsyncAcquisition() { return false; }
     static bool GetDefaultLearnAll() { return false; }
     static float GetDefaultObservationNoise() { return 0; }
     static float GetDefaultStackThreshold() { return 0; }
@@ -89,6 +109,7 @@ public:
             TEXT("Mutual Information"),
             TEXT("Hedge4"),
             TEXT("Hedge8"),
+            TEXT("Trust Region (TuRBO)"),
         };
     };
 
@@ -98,6 +119,8 @@ public:
             TEXT("Student-t NIG"), };
     };
 
+    static TArray<FName> InitialDesignMethods() { return { TEXT("Latin Hypercube"), TEXT("Sobol"), TEXT("Maximin Latin Hypercube") }; };
+
 protected:
 private:
 
@@ -107,6 +130,18 @@ private:
     typedef TArray<TSample> TSamples;
 
     void SetupInternalParameters(bopt_params& Params);
+    double GetNextStep(void* Handle, TArray<double>& X);
+    void GetNextSteps(void* Handle, const TDataset& Data, int BatchSize,
+        TArray<TArray<double>>& X, const TArray<TArray<double>>& Pending);
+    void CreateModel(void*& Handle, const bopt_params& Params) const;
+    double FitDataset(void* Handle, const TDataset& Data) const;
+    void FitBelieverModel(void*& Handle, const TDataset& Data,
+        const TArray<TArray<double>>& Pending) const;
+    void AddFantasy(void* Handle, const TArray<double>& X) const;
+    void ResetTrustRegion();
+    void UpdateTrustRegion(const TArray<TArray<double>>& X, const TArray<double>& Y);
+    bool FitLocalModel(TArray<double>& Low, TArray<double>& Scale);
+    bool ToLocal(const TArray<double>& X, TArray<double>& Local) const;
 
     FString PathToDLL;
     void* LibraryHandle;
@@ -115,5 +150,27 @@ private:
     TDataset Dataset;
     TSamples UniformSamples;
 
+    // Refit and acquisition running in the background. The model is not
+    // touched from the game thread until WaitForAsync returns.
+    TFuture<double> AsyncSteps;
+    TArray<TArray<double>> AsyncCandidates;
+
+    double InitialDesignBudget = 1;
+
+    // Trust region state (TuRBO). The edge length is measured in the unit hypercube.
+    // A local model is fitted on the samples inside the region, rescaled to [0,1]^d.
+    // LocalSynced counts the samples of Dataset already given to it
+    void* LocalModel = nullptr;
+    TDataset LocalDataset;
+    TArray<double> LocalLow;
+    TArray<double> LocalScale;
+    int LocalSynced = 0;
+    bool UseTrustRegion = false;
+    TArray<double> TrustCenter;
+    double TrustBest = 0;
+    double TrustLength = 0;
+    int TrustSuccesses = 0;
+    int TrustFailures = 0;
+
     bopt_params ModelParams;
 };
\ No newline at end of file
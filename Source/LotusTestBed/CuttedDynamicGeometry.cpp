@@ -12,6 +12,11 @@
 #include "GeometryScript/MeshQueryFunctions.h"
 #include "GeometryScript/MeshAssetFunctions.h"
 
+#include "Operations/MeshBoolean.h"
+#include "Operations/MinimalHoleFiller.h"
+#include "MeshBoundaryLoops.h"
+#include "Async/Async.h"
+
 #include <algorithm>
 
 //#define DEBUG_OUT
@@ -20,6 +25,41 @@
 // Cutted Geometry. Now it is affected by one Cutter and the cutted geometry is a Default one.
 // It can be affected by many cutters in the next revision
 
+using namespace UE::Geometry;
+
+// Same as ApplyMeshBoolean with the default options, without touching any UObject
+// so that it can run on a worker thread. Both the immediate and the staged cuts use it
+static void SubtractCutter(FDynamicMesh3& Mesh, const FDynamicMesh3& Cutter, const FTransform& Transform)
+{
+	FDynamicMesh3 Result;
+	FMeshBoolean Boolean(
+		&Mesh, FTransformSRT3d::Identity(),
+		&Cutter, (FTransformSRT3d)Transform,
+		&Result, FMeshBoolean::EBooleanOp::Difference);
+	Boolean.bPutResultInInputSpace = true;
+	Boolean.bSimplifyAlongNewEdges = true;
+	if (!Boolean.Compute())
+	{
+		UE_LOG(LogTemp, Warning, TEXT("CSG: Boolean operation failed"));
+	}
+
+	// Fill the holes along the cut
+	FMeshBoundaryLoops OpenBoundary(&Result, false);
+	TSet<int> ConsiderEdges(Boolean.CreatedBoundaryEdges);
+	OpenBoundary.EdgeFilterFunc = [&ConsiderEdges](int EID)
+	{
+		return ConsiderEdges.Contains(EID);
+	};
+	OpenBoundary.Compute();
+	for (FEdgeLoop& Loop : OpenBoundary.Loops)
+	{
+		FMinimalHoleFiller Filler(&Result, Loop);
+		Filler.Fill();
+	}
+
+	Mesh = MoveTemp(Result);
+}
+
 ACuttedDynamicGeometry::ACuttedDynamicGeometry()
 {
 	// Set this actor to call Tick() every frame.  You can turn this off to improve performance if you don't need it.
@@ -109,21 +149,26 @@ void ACuttedDynamicGeometry::ApplyCutterTransform(ECutterType type, FTransform t
 		return;
 	}	
 
+	if (m_staging)
+	{
+		// Subtracted on EndStagedCuts
+		m_staged_cutters.Emplace(cutter->GetMeshRef(), transform);
+	}
+	else
+	{
 #ifdef DEBUG_EXEC
-	double start = FPlatformTime::Seconds() * 1000;
+		double start = FPlatformTime::Seconds() * 1000;
 #endif
-	dynamic_mesh = UGeometryScriptLibrary_MeshBooleanFunctions::ApplyMeshBoolean(
-		dynamic_mesh,
-		FTransform(),
-		cutter,
-		transform,
-		EGeometryScriptBooleanOperation::Subtract,
-		FGeometryScriptMeshBooleanOptions());
+		dynamic_mesh->EditMesh([&](FDynamicMesh3& Mesh)
+		{
+			SubtractCutter(Mesh, cutter->GetMeshRef(), transform);
+		});
 
 #ifdef DEBUG_EXEC
-	double end = FPlatformTime::Seconds() * 1000;
-	UE_LOG(LogTemp, Warning, TEXT("CSG time: %.2f"), end - start);
+		double end = FPlatformTime::Seconds() * 1000;
+		UE_LOG(LogTemp, Warning, TEXT("CSG time: %.2f"), end - start);
 #endif
+	}
 
 	// Compute Actor Bounds
 	{
@@ -142,12 +187,67 @@ void ACuttedDynamicGeometry::ApplyCutterTransform(ECutterType type, FTransform t
 		UE_LOG(LogTemp, Error, TEXT("Cutter Bounds: %s"), *bbox.ToString());
 #endif
 
-		m_applied_openings_bbox.Add(bbox);
+		(m_staging ? m_staged_openings_bbox : m_applied_openings_bbox).Add(bbox);
 	}
 
 	ReleaseComputeMesh(cutter);
 }
 
+void ACuttedDynamicGeometry::BeginStagedCuts()
+{
+	DiscardStagedCuts();
+	m_staging = true;
+}
+
+void ACuttedDynamicGeometry::EndStagedCuts()
+{
+	m_staging = false;
+
+	// The worker owns its copies, so the actor can be reset or destroyed meanwhile
+	TSharedPtr<FDynamicMesh3> staged = MakeShared<FDynamicMesh3>(m_base_mesh);
+	TArray<TPair<FDynamicMesh3, FTransform>> cutters = MoveTemp(m_staged_cutters);
+	m_staged_cutters.Reset();
+
+	m_staged_mesh = Async(EAsyncExecution::ThreadPool, [staged, cutters = MoveTemp(cutters)]()
+	{
+#ifdef DEBUG_EXEC
+		double start = FPlatformTime::Seconds() * 1000;
+#endif
+		for (const auto& cutter : cutters)
+		{
+			SubtractCutter(*staged, cutter.Key, cutter.Value);
+		}
+#ifdef DEBUG_EXEC
+		double end = FPlatformTime::Seconds() * 1000;
+		UE_LOG(LogTemp, Warning, TEXT("Staged CSG time: %.2f"), end - start);
+#endif
+		return staged;
+	});
+}
+
+bool ACuttedDynamicGeometry::SwapStagedCuts()
+{
+	if (!m_staged_mesh.IsValid())
+		return false;
+
+	TSharedPtr<FDynamicMesh3> staged = m_staged_mesh.Get();
+	m_staged_mesh.Reset();
+
+	GetDynamicMeshComponent()->GetDynamicMesh()->SetMesh(MoveTemp(*staged));
+	m_applied_openings_bbox = MoveTemp(m_staged_openings_bbox);
+	m_staged_openings_bbox.Reset();
+	return true;
+}
+
+void ACuttedDynamicGeometry::DiscardStagedCuts()
+{
+	// A running worker finishes on its own copies
+	m_staged_mesh.Reset();
+	m_staged_cutters.Reset();
+	m_staged_openings_bbox.Reset();
+	m_staging = false;
+}
+
 void ACuttedDynamicGeometry::Reset()
 {
 	if (CuttedMesh == nullptr)
@@ -190,6 +290,7 @@ void ACuttedDynamicGeometry::Reset()
 	Cast<UStaticMeshComponent>(CuttedMesh->GetComponentByClass(UStaticMeshComponent::StaticClass()))->SetVisibility(false);
 
 	m_applied_openings_bbox.Empty();
+	m_base_mesh = dynamic_mesh->GetMeshRef();
 }
 
 void ACuttedDynamicGeometry::ResetDebug()
@@ -4,6 +4,8 @@
 
 #include "CoreMinimal.h"
 #include "DynamicMeshActor.h"
+#include "DynamicMesh/DynamicMesh3.h"
+#include "Async/Future.h"
 #include "CuttedDynamicGeometry.generated.h"
 
 UENUM(BlueprintType)
@@ -41,6 +43,14 @@ public: // UI
 	UFUNCTION(BlueprintCallable, CallInEditor, Category = "Cutted")
 		void Reset();
 
+	// Staged cutting. The cutters applied between BeginStagedCuts and EndStagedCuts are
+	// subtracted from a copy of the reset geometry on a worker thread, and the result
+	// replaces the geometry on SwapStagedCuts. The current geometry is not modified.
+	void BeginStagedCuts();
+	void EndStagedCuts();
+	bool SwapStagedCuts(); // Waits for the worker
+	void DiscardStagedCuts();
+
 	// Cutter
 	//UPROPERTY(EditAnywhere, Category = "Cutter", DisplayName = "Static Meshes to use for cutting")
 	//TArray<TObjectPtr<class UStaticMeshComponent>> CutterMeshes;
@@ -71,5 +81,13 @@ public: // UI
 private:
 	TArray<FBox> m_applied_openings_bbox;
 
+	// Reset geometry, the input of the staged cuts
+	UE::Geometry::FDynamicMesh3 m_base_mesh;
+
+	bool m_staging = false;
+	TArray<TPair<UE::Geometry::FDynamicMesh3, FTransform>> m_staged_cutters;
+	TArray<FBox> m_staged_openings_bbox;
+	TFuture<TSharedPtr<UE::Geometry::FDynamicMesh3>> m_staged_mesh;
+
 	TObjectPtr<class UStaticMesh> m_s_shape_mesh = nullptr;
 };
@@ -0,0 +1,427 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "DaylightFactorEvaluator.h"
+#include "OpeningDomain.h"
+#include "ViewSampler.h"
+#include "PlanarSampler.h"
+#include "CuttedDynamicGeometry.h"
+#include "Components/SceneCaptureComponent2D.h"
+#include "Engine/TextureCube.h"
+
+#define SKY_TABLE_WIDTH 64
+#define SKY_TABLE_HEIGHT 32
+#define SKY_SOURCE_RESOLUTION 64
+
+namespace
+{
+	// Cube face texel to world direction, same convention as the engine texture compressor
+	FVector3f CubeFaceDirection(int Face, float U, float V)
+	{
+		const FVector3f d = FVector3f(U, V, 1.f).GetSafeNormal();
+		FVector3f ret;
+		switch (Face)
+		{
+			case 0: ret = FVector3f(+d.Z, -d.Y, -d.X); break;
+			case 1: ret = FVector3f(-d.Z, -d.Y, +d.X); break;
+			case 2: ret = FVector3f(+d.X, +d.Z, +d.Y); break;
+			case 3: ret = FVector3f(+d.X, -d.Z, -d.Y); break;
+			case 4: ret = FVector3f(+d.X, -d.Y, +d.Z); break;
+			default: ret = FVector3f(-d.X, -d.Y, -d.Z); break;
+		}
+		// z and y are flipped in Unreal
+		return FVector3f(ret.X, ret.Z, ret.Y);
+	}
+
+	// Long-lat texel to world direction
+	FVector3f LongLatDirection(float U, float V)
+	{
+		const float phi = (2.f * U - 1.f) * PI;
+		const float theta = V * PI;
+		return FVector3f(FMath::Sin(theta) * FMath::Sin(phi), -FMath::Sin(theta) * FMath::Cos(phi), FMath::Cos(theta));
+	}
+
+	bool DecodeTexel(ETextureSourceFormat Format, const uint8* Data, FLinearColor& Color)
+	{
+		switch (Format)
+		{
+			case TSF_RGBA16F: Color = FLinearColor(*reinterpret_cast<const FFloat16Color*>(Data)); return true;
+			case TSF_BGRE8: Color = reinterpret_cast<const FColor*>(Data)->FromRGBE(); return true;
+			case TSF_BGRA8: Color = FLinearColor::FromSRGBColor(*reinterpret_cast<const FColor*>(Data)); return true;
+			default: return false;
+		}
+	}
+}
+
+bool FDaylightFactorEvaluator::FSkyTable::Build(UTextureCube* EnvMap, float Scale)
+{
+	Width = SKY_TABLE_WIDTH;
+	Height = SKY_TABLE_HEIGHT;
+	Radiance.Init(FLinearColor(0, 0, 0, 0), Width * Height);
+	TArray<int> count;
+	count.Init(0, Width * Height);
+
+	auto splat = [&](const FVector3f& Dir, const FLinearColor& Color)
+	{
+		const float phi = FMath::Atan2(Dir.Y, Dir.X);
+		const float theta = FMath::Acos(FMath::Clamp(Dir.Z, -1.f, 1.f));
+		const int x = FMath::Clamp(int((phi + PI) / (2.f * PI) * Width), 0, Width - 1);
+		const int y = FMath::Clamp(int(theta / PI * Height), 0, Height - 1);
+		Radiance[y * Width + x] += Color;
+		count[y * Width + x]++;
+	};
+
+	bool valid = false;
+#if WITH_EDITORONLY_DATA
+	if (EnvMap && EnvMap->Source.IsValid())
+	{
+		FTextureSource& source = EnvMap->Source;
+		const ETextureSourceFormat format = source.GetFormat();
+		const int bpp = source.GetBytesPerPixel();
+		FLinearColor color;
+
+		if (source.IsLongLatCubemap())
+		{
+			// Equirectangular source, visited with a stride
+			TArray64<uint8> data;
+			if (source.GetMipData(data, 0, 0, 0) && DecodeTexel(format, data.GetData(), color))
+			{
+				const int size_x = source.GetSizeX();
+				const int size_y = source.GetSizeY();
+				const int stride = FMath::Max(1, size_x / (4 * SKY_SOURCE_RESOLUTION));
+				for (int y = 0; y < size_y; y += stride)
+				{
+					for (int x = 0; x < size_x; x += stride)
+					{
+						DecodeTexel(format, &data[(int64(y) * size_x + x) * bpp], color);
+						splat(LongLatDirection((x + 0.5f) / size_x, (y + 0.5f) / size_y), color);
+					}
+				}
+				valid = true;
+			}
+		}
+		else if (source.GetNumSlices() == 6)
+		{
+			// Smallest mip that still fills the table
+			int mip = 0;
+			while (mip + 1 < source.GetNumMips() && (source.GetSizeX() >> (mip + 1)) >= SKY_SOURCE_RESOLUTION)
+				++mip;
+
+			TArray64<uint8> data;
+			if (source.GetMipData(data, 0, 0, mip) && DecodeTexel(format, data.GetData(), color))
+			{
+				const int size = FMath::Max(source.GetSizeX() >> mip, 1);
+				for (int face = 0; face < 6; ++face)
+				{
+					for (int y = 0; y < size; ++y)
+					{
+						for (int x = 0; x < size; ++x)
+						{
+							DecodeTexel(format, &data[((int64(face) * size + y) * size + x) * bpp], color);
+							splat(CubeFaceDirection(face, (x + 0.5f) * 2.f / size - 1.f, (y + 0.5f) * 2.f / size - 1.f), color);
+						}
+					}
+				}
+				valid = true;
+			}
+		}
+	}
+#endif
+
+	if (!valid)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("DaylightFactor: Cannot read %s, using a uniform sky"), *GetNameSafe(EnvMap));
+		Width = Height = 1;
+		Radiance = { FLinearColor(Scale, Scale, Scale, 0) };
+		return false;
+	}
+
+	for (int i = 0; i < Radiance.Num(); ++i)
+	{
+		if (count[i] > 0) Radiance[i] *= Scale / count[i];
+	}
+
+	// Bins near the poles may get no texel, copy the closest filled bin of the row
+	for (int y = 0; y < Height; ++y)
+	{
+		for (int x = 0; x < Width; ++x)
+		{
+			if (count[y * Width + x] > 0) continue;
+			for (int offset = 1; offset < Width; ++offset)
+			{
+				const int neighbor = y * Width + (x + offset) % Width;
+				if (count[neighbor] > 0)
+				{
+					Radiance[y * Width + x] = Radiance[neighbor];
+					break;
+				}
+			}
+		}
+	}
+	return true;
+}
+
+FLinearColor FDaylightFactorEvaluator::FSkyTable::Lookup(float X, float Y, float Z) const
+{
+	const float phi = FMath::Atan2(Y, X);
+	const float theta = FMath::Acos(FMath::Clamp(Z, -1.f, 1.f));
+	const int x = FMath::Clamp(int((phi + PI) / (2.f * PI) * Width), 0, Width - 1);
+	const int y = FMath::Clamp(int(theta / PI * Height), 0, Height - 1);
+	return Radiance[y * Width + x];
+}
+
+void FDaylightFactorEvaluator::FPatches::Reset()
+{
+	PX.Reset(); PY.Reset(); PZ.Reset();
+	NX.Reset(); NY.Reset(); NZ.Reset();
+	Area.Reset();
+}
+
+void FDaylightFactorEvaluator::FPatches::Add(const FVector3f& P, const FVector3f& N, float A)
+{
+	PX.Add(P.X); PY.Add(P.Y); PZ.Add(P.Z);
+	NX.Add(N.X); NY.Add(N.Y); NZ.Add(N.Z);
+	Area.Add(A);
+}
+
+FDaylightFactorEvaluator::FDaylightFactorEvaluator(UTextureCube* MaxEnvMap, UTextureCube* AvgEnvMap, float LightEfficacy)
+	: m_max_env_map(MaxEnvMap)
+	, m_avg_env_map(AvgEnvMap)
+	, m_light_efficacy(LightEfficacy)
+{
+}
+
+void FDaylightFactorEvaluator::Prepare(const TArray<AOpeningDomain*>& Domains,
+	const TArray<AViewSampler*>& ViewSamplers,
+	const TArray<APlanarSampler*>& PlanarSamplers)
+{
+	const bool has_max_sky = m_max_sky.Build(m_max_env_map, m_light_efficacy);
+	const bool has_avg_sky = m_avg_sky.Build(m_avg_env_map, m_light_efficacy);
+	m_has_sky_data = has_max_sky && has_avg_sky;
+
+	// Fallback of the planar ratios when no opening lets the sky in
+	FLinearColor max_total(0, 0, 0, 0), avg_total(0, 0, 0, 0);
+	for (const FLinearColor& radiance : m_max_sky.Radiance) max_total += radiance;
+	for (const FLinearColor& radiance : m_avg_sky.Radiance) avg_total += radiance;
+	const float max_length = FVector3f(max_total.R, max_total.G, max_total.B).Length();
+	m_sky_ratio = max_length > 0.f ? FVector3f(avg_total.R, avg_total.G, avg_total.B).Length() / max_length : 1.f;
+
+	// Texel centers on the gather plane of each planar sampler
+	m_planar_texels.SetNum(PlanarSamplers.Num());
+	m_planar_normals.SetNum(PlanarSamplers.Num());
+	for (int s = 0; s < PlanarSamplers.Num(); ++s)
+	{
+		const FVector3f forward(PlanarSamplers[s]->GetActorForwardVector());
+		const FVector3f right(PlanarSamplers[s]->GetActorRightVector());
+		const FVector3f up(PlanarSamplers[s]->GetActorUpVector());
+		const FVector3f center = FVector3f(PlanarSamplers[s]->GetActorLocation()) + forward * PLANAR_SAMPLER_OFFSET;
+		const float half_width = 0.5f * PlanarSamplers[s]->GetCaptureComponent2D()->OrthoWidth;
+
+		m_planar_normals[s] = -forward;
+		m_planar_texels[s].Reset();
+		for (int y = 0; y < m_planar_resolution; ++y)
+		{
+			for (int x = 0; x < m_planar_resolution; ++x)
+			{
+				const float u = (x + 0.5f) * 2.f / m_planar_resolution - 1.f;
+				const float v = (y + 0.5f) * 2.f / m_planar_resolution - 1.f;
+				m_planar_texels[s].Add(center + (right * u + up * v) * half_width);
+			}
+		}
+	}
+
+	// Pixel rays of each view sampler
+	m_view_rays.SetNum(ViewSamplers.Num());
+	m_view_origins.SetNum(ViewSamplers.Num());
+	m_view_forwards.SetNum(ViewSamplers.Num());
+	for (int s = 0; s < ViewSamplers.Num(); ++s)
+	{
+		const FVector3f forward(ViewSamplers[s]->GetActorForwardVector());
+		const FVector3f right(ViewSamplers[s]->GetActorRightVector());
+		const FVector3f up(ViewSamplers[s]->GetActorUpVector());
+		const float tan_half_fov = FMath::Tan(FMath::DegreesToRadians(ViewSamplers[s]->GetCaptureComponent2D()->FOVAngle) * 0.5f);
+
+		m_view_origins[s] = FVector3f(ViewSamplers[s]->GetActorLocation());
+		m_view_forwards[s] = forward;
+		m_view_rays[s].Reset();
+		for (int y = 0; y < m_view_resolution; ++y)
+		{
+			for (int x = 0; x < m_view_resolution; ++x)
+			{
+				const float u = (x + 0.5f) * 2.f / m_view_resolution - 1.f;
+				const float v = (y + 0.5f) * 2.f / m_view_resolution - 1.f;
+				m_view_rays[s].Add((forward + (right * u + up * v) * tan_half_fov).GetSafeNormal());
+			}
+		}
+	}
+}
+
+void FDaylightFactorEvaluator::GatherOpenings(const TArray<AOpeningDomain*>& Domains)
+{
+	m_openings.Reset();
+	m_patches.Reset();
+
+	const int subdivisions = FMath::Max(m_opening_subdivisions, 1);
+	for (auto domain : Domains)
+	{
+		if (domain->CuttedMesh == nullptr) continue;
+
+		// Opening boxes are in the space of the cutted mesh
+		const FTransform transform = domain->CuttedMesh->GetActorTransform();
+		const FVector3f domain_normal(domain->GetActorUpVector());
+		for (const FBox& box : domain->GetOpeningsBBOX())
+		{
+			const FVector extent = box.GetExtent();
+			const FVector3f axes[3] = {
+				FVector3f(transform.TransformVector(FVector(extent.X, 0, 0))),
+				FVector3f(transform.TransformVector(FVector(0, extent.Y, 0))),
+				FVector3f(transform.TransformVector(FVector(0, 0, extent.Z))) };
+
+			// the box axis closest to the domain normal crosses the wall
+			int n = 0;
+			for (int k = 1; k < 3; ++k)
+			{
+				if (FMath::Abs(FVector3f::DotProduct(axes[k].GetSafeNormal(), domain_normal)) >
+					FMath::Abs(FVector3f::DotProduct(axes[n].GetSafeNormal(), domain_normal)))
+					n = k;
+			}
+
+			FRect rect;
+			rect.Center = FVector3f(transform.TransformPosition(box.GetCenter()));
+			rect.U = axes[(n + 1) % 3];
+			rect.V = axes[(n + 2) % 3];
+			rect.Normal = FVector3f::CrossProduct(rect.U, rect.V).GetSafeNormal();
+			m_openings.Add(rect);
+
+			const float patch_area = 4.f * FVector3f::CrossProduct(rect.U, rect.V).Size() / (subdivisions * subdivisions);
+			for (int j = 0; j < subdivisions; ++j)
+			{
+				for (int i = 0; i < subdivisions; ++i)
+				{
+					const float u = (i + 0.5f) * 2.f / subdivisions - 1.f;
+					const float v = (j + 0.5f) * 2.f / subdivisions - 1.f;
+					m_patches.Add(rect.Center + rect.U * u + rect.V * v, rect.Normal, patch_area);
+				}
+			}
+		}
+	}
+}
+
+FLinearColor FDaylightFactorEvaluator::Irradiance(const FVector3f& P, const FVector3f& N, const FSkyTable& Sky)
+{
+	const int num = m_patches.Num();
+	m_weights.SetNumUninitialized(num, false);
+	m_dir_x.SetNumUninitialized(num, false);
+	m_dir_y.SetNumUninitialized(num, false);
+	m_dir_z.SetNumUninitialized(num, false);
+
+	const float* px = m_patches.PX.GetData();
+	const float* py = m_patches.PY.GetData();
+	const float* pz = m_patches.PZ.GetData();
+	const float* nx = m_patches.NX.GetData();
+	const float* ny = m_patches.NY.GetData();
+	const float* nz = m_patches.NZ.GetData();
+	const float* area = m_patches.Area.GetData();
+	float* weight = m_weights.GetData();
+	float* dir_x = m_dir_x.GetData();
+	float* dir_y = m_dir_y.GetData();
+	float* dir_z = m_dir_z.GetData();
+
+	// Point to patch form factors, branch free so that the loop vectorizes
+	for (int i = 0; i < num; ++i)
+	{
+		const float dx = px[i] - P.X;
+		const float dy = py[i] - P.Y;
+		const float dz = pz[i] - P.Z;
+		// the patch area bounds the form factor of nearby receivers
+		const float dist2 = FMath::Max(dx * dx + dy * dy + dz * dz, area[i]);
+		const float inv_dist = FMath::InvSqrt(dist2);
+		const float ux = dx * inv_dist;
+		const float uy = dy * inv_dist;
+		const float uz = dz * inv_dist;
+		const float cos_receiver = FMath::Max(N.X * ux + N.Y * uy + N.Z * uz, 0.f);
+		const float cos_opening = FMath::Abs(nx[i] * ux + ny[i] * uy + nz[i] * uz);
+		weight[i] = cos_receiver * cos_opening * area[i] / dist2;
+		dir_x[i] = ux;
+		dir_y[i] = uy;
+		dir_z[i] = uz;
+	}
+
+	// Sky radiance through each patch
+	FLinearColor irradiance(0, 0, 0, 0);
+	for (int i = 0; i < num; ++i)
+	{
+		if (weight[i] > 0.f)
+			irradiance += Sky.Lookup(dir_x[i], dir_y[i], dir_z[i]) * weight[i];
+	}
+	return irradiance;
+}
+
+void FDaylightFactorEvaluator::Evaluate(const TArray<AOpeningDomain*>& Domains,
+	const TArray<AViewSampler*>& ViewSamplers,
+	const TArray<APlanarSampler*>& PlanarSamplers,
+	FSamplerEvaluation& Evaluation)
+{
+	this->GatherOpenings(Domains);
+
+	Evaluation.planar_values.SetNum(m_planar_texels.Num());
+	for (int s = 0; s < m_planar_texels.Num(); ++s)
+	{
+		Evaluation.planar_values[s] = this->PlanarIlluminance(s, m_avg_sky);
+	}
+
+	Evaluation.view_values.SetNum(m_view_rays.Num());
+	for (int s = 0; s < m_view_rays.Num(); ++s)
+	{
+		const FVector3f& origin = m_view_origins[s];
+
+		// Pixels that miss the openings see the interior, lit like a wall facing the view
+		const FLinearColor interior = this->Irradiance(origin, m_view_forwards[s], m_max_sky) * (m_interior_reflectance / PI);
+		float max_luminance = FVector3f(interior.R, interior.G, interior.B).Length();
+
+		for (const FVector3f& ray : m_view_rays[s])
+		{
+			for (const FRect& rect : m_openings)
+			{
+				const float denom = FVector3f::DotProduct(ray, rect.Normal);
+				if (FMath::Abs(denom) < KINDA_SMALL_NUMBER) continue;
+
+				const float t = FVector3f::DotProduct(rect.Center - origin, rect.Normal) / denom;
+				if (t <= 0.f) continue;
+
+				const FVector3f hit = origin + ray * t - rect.Center;
+				if (FMath::Abs(FVector3f::DotProduct(hit, rect.U)) <= rect.U.SizeSquared() &&
+					FMath::Abs(FVector3f::DotProduct(hit, rect.V)) <= rect.V.SizeSquared())
+				{
+					const FLinearColor sky = m_max_sky.Lookup(ray.X, ray.Y, ray.Z);
+					max_luminance = FMath::Max(max_luminance, FVector3f(sky.R, sky.G, sky.B).Length());
+					break;
+				}
+			}
+		}
+
+		Evaluation.view_values[s] = max_luminance;
+	}
+}
+
+float FDaylightFactorEvaluator::PlanarIlluminance(int Sampler, const FSkyTable& Sky)
+{
+	FLinearColor illuminance(0, 0, 0, 0);
+	for (const FVector3f& texel : m_planar_texels[Sampler])
+		illuminance += this->Irradiance(texel, m_planar_normals[Sampler], Sky);
+	illuminance /= FMath::Max(m_planar_texels[Sampler].Num(), 1);
+
+	return FVector3f(illuminance.R, illuminance.G, illuminance.B).Length();
+}
+
+void FDaylightFactorEvaluator::EvaluatePlanarSkyRatios(const TArray<AOpeningDomain*>& Domains, TArray<double>& Ratios)
+{
+	this->GatherOpenings(Domains);
+
+	Ratios.SetNum(m_planar_texels.Num());
+	for (int s = 0; s < m_planar_texels.Num(); ++s)
+	{
+		const float max_illuminance = this->PlanarIlluminance(s, m_max_sky);
+		Ratios[s] = max_illuminance > KINDA_SMALL_NUMBER ?
+			this->PlanarIlluminance(s, m_avg_sky) / max_illuminance : m_sky_ratio;
+	}
+}
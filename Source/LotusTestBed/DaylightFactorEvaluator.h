@@ -0,0 +1,111 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "ObjectiveEvaluator.h"
+
+class UTextureCube;
+
+/*
+	Daylight Factor Evaluator approximates the path-traced samplers on the CPU.
+	The openings are the rectangles cut by the domains, the sky is read from the
+	env maps of the engine (max for the view samplers, avg for the planar ones).
+
+	Planar samplers: illuminance averaged over a grid of texels on the gather plane,
+	integrating the sky radiance through the openings (subdivided into patches) with
+	the point-to-patch form factor.
+	View samplers: maximum luminance over a grid of pixels, a pixel sees the sky if
+	its ray crosses an opening, or diffuse interreflection of the interior otherwise.
+
+	Walls do not occlude the openings. Usable as a low-fidelity surrogate or to
+	pre-screen candidates, not as a replacement of the renderer.
+*/
+class LOTUSTESTBED_API FDaylightFactorEvaluator : public IObjectiveEvaluator
+{
+public:
+	FDaylightFactorEvaluator(UTextureCube* MaxEnvMap, UTextureCube* AvgEnvMap, float LightEfficacy);
+
+	virtual FString GetName() const override { return TEXT("DaylightFactor"); }
+
+	virtual void Prepare(const TArray<AOpeningDomain*>& Domains,
+		const TArray<AViewSampler*>& ViewSamplers,
+		const TArray<APlanarSampler*>& PlanarSamplers) override;
+
+	virtual void Evaluate(const TArray<AOpeningDomain*>& Domains,
+		const TArray<AViewSampler*>& ViewSamplers,
+		const TArray<APlanarSampler*>& PlanarSamplers,
+		FSamplerEvaluation& Evaluation) override;
+
+	// Ratio of the planar illuminance under the avg env map to the one under the max
+	// env map, for the applied cutters. Rescales planar samplers rendered with the
+	// max env map (single pass rendering), since light transport is linear in the sky.
+	void EvaluatePlanarSkyRatios(const TArray<AOpeningDomain*>& Domains, TArray<double>& Ratios);
+
+	// Whether both env maps were read in Prepare. Their source data only exists in
+	// editor builds, otherwise the skies are uniform and every ratio is the same.
+	bool HasSkyData() const { return m_has_sky_data; }
+
+	int m_planar_resolution = 8; // texels per side of a planar sampler
+	int m_view_resolution = 16; // pixels per side of a view sampler
+	int m_opening_subdivisions = 4; // patches per side of an opening
+	float m_interior_reflectance = 0.5f;
+
+private:
+
+	// Sky radiance binned by direction (longitude, latitude)
+	struct FSkyTable {
+		int Width = 0;
+		int Height = 0;
+		TArray<FLinearColor> Radiance;
+
+		bool Build(UTextureCube* EnvMap, float Scale);
+		FLinearColor Lookup(float X, float Y, float Z) const;
+	};
+
+	// Opening patches, structure of arrays
+	struct FPatches {
+		TArray<float> PX, PY, PZ; // center
+		TArray<float> NX, NY, NZ; // normal
+		TArray<float> Area;
+
+		void Reset();
+		void Add(const FVector3f& P, const FVector3f& N, float A);
+		int Num() const { return Area.Num(); }
+	};
+
+	// Opening rectangle with half axes
+	struct FRect {
+		FVector3f Center;
+		FVector3f U;
+		FVector3f V;
+		FVector3f Normal;
+	};
+
+	void GatherOpenings(const TArray<AOpeningDomain*>& Domains);
+	FLinearColor Irradiance(const FVector3f& P, const FVector3f& N, const FSkyTable& Sky);
+	float PlanarIlluminance(int Sampler, const FSkyTable& Sky);
+
+	UTextureCube* m_max_env_map;
+	UTextureCube* m_avg_env_map;
+	float m_light_efficacy;
+
+	FSkyTable m_max_sky;
+	FSkyTable m_avg_sky;
+	float m_sky_ratio = 1.f; // avg to max, over the whole sphere
+	bool m_has_sky_data = false;
+
+	TArray<FRect> m_openings;
+	FPatches m_patches;
+
+	// Per patch scratch of Irradiance
+	TArray<float> m_weights;
+	TArray<float> m_dir_x, m_dir_y, m_dir_z;
+
+	// Sampler geometry, fixed during an optimization
+	TArray<TArray<FVector3f>> m_planar_texels;
+	TArray<FVector3f> m_planar_normals;
+	TArray<TArray<FVector3f>> m_view_rays;
+	TArray<FVector3f> m_view_origins;
+	TArray<FVector3f> m_view_forwards;
+};
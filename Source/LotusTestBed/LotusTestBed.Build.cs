@@ -30,6 +30,8 @@ public class LotusTestBed : ModuleRules
 			"RenderCore",
 			"RHI",
 			"GeometryFramework",
+			"GeometryCore",
+			"DynamicMesh",
             "GeometryScriptingCore",
             "GeometryScriptingEditor",
 		});
@@ -44,11 +46,22 @@ public class LotusTestBed : ModuleRules
 			"RHI",
 		});
 
-		PublicDelayLoadDLLs.AddRange(new string[] { "bayesopt.dll" });
+		// BayesOpt is only prebuilt for Windows. Elsewhere (e.g. headless benchmarks
+		// on Linux) the Bayesian optimizer is disabled, see BayesOptUnavailable.cpp
+		if (Target.Platform == UnrealTargetPlatform.Win64)
+		{
+			PublicDefinitions.Add("WITH_BAYESOPT=1");
 
-		PublicAdditionalLibraries.AddRange(new string[] {
-			Path.Combine(BayesOptPath, "BayesOpt", "lib", "Release", "BayesOpt.lib"),
-			Path.Combine(BayesOptPath, "BayesOpt", "lib", "Debug", "BayesOpt.lib"),});
+			PublicDelayLoadDLLs.AddRange(new string[] { "bayesopt.dll" });
+
+			PublicAdditionalLibraries.AddRange(new string[] {
+				Path.Combine(BayesOptPath, "BayesOpt", "lib", "Release", "BayesOpt.lib"),
+				Path.Combine(BayesOptPath, "BayesOpt", "lib", "Debug", "BayesOpt.lib"),});
+		}
+		else
+		{
+			PublicDefinitions.Add("WITH_BAYESOPT=0");
+		}
 
 		// Uncomment if you are using Slate UI
 		// PrivateDependencyModuleNames.AddRange(new string[] { "Slate", "SlateCore" });
@@ -0,0 +1,88 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "ObjectiveEvaluator.h"
+#include "OpeningDomain.h"
+#include "ViewSampler.h"
+#include "PlanarSampler.h"
+#include "CuttedDynamicGeometry.h"
+#include "Components/SceneCaptureComponent2D.h"
+
+void FPointSourceEvaluator::Evaluate(const TArray<AOpeningDomain*>& Domains,
+	const TArray<AViewSampler*>& ViewSamplers,
+	const TArray<APlanarSampler*>& PlanarSamplers,
+	FSamplerEvaluation& Evaluation)
+{
+	// Gather the openings in world space
+	TArray<FVector> centers;
+	TArray<FVector> normals;
+	TArray<double> areas;
+	for (auto domain : Domains)
+	{
+		if (domain->CuttedMesh == nullptr) continue;
+
+		const FTransform transform = domain->CuttedMesh->GetActorTransform();
+		const FVector normal = domain->GetActorUpVector();
+		for (const FBox& box : domain->GetOpeningsBBOX())
+		{
+			const FBox world_box = box.TransformBy(transform);
+			const FVector size = world_box.GetSize();
+			// the opening is the largest face of its box
+			const double area = FMath::Max3(size.X * size.Y, size.Y * size.Z, size.X * size.Z);
+			centers.Add(world_box.GetCenter());
+			normals.Add(normal);
+			areas.Add(area);
+		}
+	}
+
+	// Samplers report the length of an RGB value
+	const double sky_luminance = FMath::Sqrt(3.0) * m_sky_illuminance / PI;
+
+	// Solid angle subtended by an opening, seen from position
+	auto solid_angle = [&](int i, const FVector& position, const FVector& direction, double& cos_receiver) -> double
+	{
+		const FVector to_opening = centers[i] - position;
+		const double dist2 = FMath::Max(to_opening.SizeSquared(), 1.0);
+		const FVector dir = to_opening / FMath::Sqrt(dist2);
+		// openings emit on both sides
+		const double cos_opening = FMath::Abs(FVector::DotProduct(normals[i], dir));
+		cos_receiver = FVector::DotProduct(direction, dir);
+		return FMath::Min(areas[i] * cos_opening / dist2, 2.0 * PI);
+	};
+
+	Evaluation.planar_values.SetNum(PlanarSamplers.Num());
+	for (int s = 0; s < PlanarSamplers.Num(); ++s)
+	{
+		const FVector forward = PlanarSamplers[s]->GetActorForwardVector();
+		const FVector position = PlanarSamplers[s]->GetActorLocation() + forward * PLANAR_SAMPLER_OFFSET;
+		const FVector normal = -forward;
+
+		double illuminance = 0;
+		for (int i = 0; i < centers.Num(); ++i)
+		{
+			double cos_receiver = 0;
+			const double omega = solid_angle(i, position, normal, cos_receiver);
+			if (cos_receiver > 0) illuminance += sky_luminance * omega * cos_receiver;
+		}
+		Evaluation.planar_values[s] = illuminance;
+	}
+
+	Evaluation.view_values.SetNum(ViewSamplers.Num());
+	for (int s = 0; s < ViewSamplers.Num(); ++s)
+	{
+		const FVector position = ViewSamplers[s]->GetActorLocation();
+		const FVector forward = ViewSamplers[s]->GetActorForwardVector();
+		const double half_fov = FMath::DegreesToRadians(ViewSamplers[s]->GetCaptureComponent2D()->FOVAngle) * 0.5;
+		const double cos_half_fov = FMath::Cos(half_fov);
+		const double fov_solid_angle = 4.0 * FMath::Asin(FMath::Square(FMath::Sin(half_fov)));
+
+		// Fraction of the view covered by sky
+		double visible = 0;
+		for (int i = 0; i < centers.Num(); ++i)
+		{
+			double cos_view = 0;
+			const double omega = solid_angle(i, position, forward, cos_view);
+			if (cos_view > cos_half_fov) visible += omega;
+		}
+		Evaluation.view_values[s] = sky_luminance * FMath::Min(visible / fov_solid_angle, 1.0);
+	}
+}
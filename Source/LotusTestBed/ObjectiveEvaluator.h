@@ -0,0 +1,61 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+class AOpeningDomain;
+class AViewSampler;
+class APlanarSampler;
+
+// Sampler readings of a cutter configuration, in the order of the engine samplers
+struct FSamplerEvaluation {
+	TArray<double> view_values;
+	TArray<double> planar_values;
+};
+
+/*
+	Objective Evaluator replaces the path-traced samplers. The engine calls it once
+	the cutter transforms of a configuration are applied, so the optimizers can run
+	without a GPU (see UOpeningBenchmarkCommandlet).
+*/
+class LOTUSTESTBED_API IObjectiveEvaluator
+{
+public:
+	virtual ~IObjectiveEvaluator() = default;
+
+	// Identifies the evaluator in the evaluation cache
+	virtual FString GetName() const = 0;
+
+	// Called once the domains and samplers of an optimization are known
+	virtual void Prepare(const TArray<AOpeningDomain*>& Domains,
+		const TArray<AViewSampler*>& ViewSamplers,
+		const TArray<APlanarSampler*>& PlanarSamplers) {}
+
+	// Sampler values of the applied cutter configuration
+	virtual void Evaluate(const TArray<AOpeningDomain*>& Domains,
+		const TArray<AViewSampler*>& ViewSamplers,
+		const TArray<APlanarSampler*>& PlanarSamplers,
+		FSamplerEvaluation& Evaluation) = 0;
+};
+
+/*
+	Cheap analytic stand-in: every opening is a small Lambertian source of uniform
+	sky luminance placed at the center of its bounding box. There is no occlusion
+	and no interreflection, so the values only follow the trends of the renderer.
+*/
+class LOTUSTESTBED_API FPointSourceEvaluator : public IObjectiveEvaluator
+{
+public:
+	FPointSourceEvaluator(double SkyIlluminance = 10000.0) : m_sky_illuminance(SkyIlluminance) {}
+
+	virtual FString GetName() const override { return TEXT("PointSource"); }
+
+	virtual void Evaluate(const TArray<AOpeningDomain*>& Domains,
+		const TArray<AViewSampler*>& ViewSamplers,
+		const TArray<APlanarSampler*>& PlanarSamplers,
+		FSamplerEvaluation& Evaluation) override;
+
+private:
+	double m_sky_illuminance; // lux on an unobstructed horizontal plane
+};
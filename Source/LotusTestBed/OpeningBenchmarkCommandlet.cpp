@@ -0,0 +1,174 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "OpeningBenchmarkCommandlet.h"
+#include "OpeningEngine.h"
+#include "ObjectiveEvaluator.h"
+#include "DaylightFactorEvaluator.h"
+
+#include "EngineUtils.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Misc/ScopeExit.h"
+
+UOpeningBenchmarkCommandlet::UOpeningBenchmarkCommandlet()
+{
+	IsClient = false;
+	IsEditor = true;
+	IsServer = false;
+	LogToConsole = true;
+}
+
+int32 UOpeningBenchmarkCommandlet::Main(const FString& Params)
+{
+	TArray<FString> Tokens;
+	TArray<FString> Switches;
+	TMap<FString, FString> ParamVals;
+	ParseCommandLine(*Params, Tokens, Switches, ParamVals);
+
+	const FString MapName = ParamVals.FindRef(TEXT("map"));
+	const FString Algorithm = ParamVals.Contains(TEXT("algorithm")) ? ParamVals[TEXT("algorithm")] : FString(TEXT("all"));
+	const int Steps = FCString::Atoi(*ParamVals.FindRef(TEXT("steps")));
+	const FString Evaluator = ParamVals.Contains(TEXT("evaluator")) ? ParamVals[TEXT("evaluator")] : FString(TEXT("daylight"));
+	const bool UseCache = Switches.Contains(TEXT("cache"));
+
+	if (MapName.IsEmpty())
+	{
+		UE_LOG(LogTemp, Error, TEXT("OpeningBenchmark: Missing -map=<level package>"));
+		return 1;
+	}
+
+	// Load the level without rendering
+	UPackage* Package = LoadPackage(nullptr, *MapName, LOAD_None);
+	UWorld* World = Package ? UWorld::FindWorldInPackage(Package) : nullptr;
+	if (World == nullptr)
+	{
+		UE_LOG(LogTemp, Error, TEXT("OpeningBenchmark: Cannot load %s"), *MapName);
+		return 1;
+	}
+
+	World->WorldType = EWorldType::Editor;
+	World->AddToRoot();
+	if (!World->bIsWorldInitialized)
+	{
+		World->InitWorld(UWorld::InitializationValues()
+			.AllowAudioPlayback(false)
+			.CreatePhysicsScene(false)
+			.RequiresHitProxies(false)
+			.CreateNavigation(false)
+			.CreateAISystem(false)
+			.ShouldSimulatePhysics(false)
+			.SetTransactional(false));
+	}
+	World->UpdateWorldComponents(true, false);
+
+	AOpeningEngine* Engine = nullptr;
+	for (TActorIterator<AOpeningEngine> It(World); It; ++It)
+	{
+		Engine = *It;
+		break;
+	}
+
+	int32 Result = 0;
+	if (Engine == nullptr)
+	{
+		UE_LOG(LogTemp, Error, TEXT("OpeningBenchmark: %s has no Opening Engine"), *MapName);
+		Result = 1;
+	}
+	else
+	{
+		if (Evaluator == TEXT("pointsource"))
+			Engine->SetObjectiveEvaluator(MakeShared<FPointSourceEvaluator>());
+		else
+			Engine->SetObjectiveEvaluator(MakeShared<FDaylightFactorEvaluator>(Engine->m_max_env_map, Engine->m_avg_env_map, Engine->m_light_efficacy));
+		const bool enable_checkpoint = Engine->m_enable_checkpoint;
+		const bool enable_eval_cache = Engine->m_enable_eval_cache;
+		Engine->m_enable_checkpoint = false;
+		Engine->m_enable_eval_cache = UseCache;
+
+		const FString LevelName = FPaths::GetBaseFilename(MapName);
+		for (const TCHAR* Name : { TEXT("random"), TEXT("sa"), TEXT("bo") })
+		{
+			if (Algorithm != TEXT("all") && Algorithm != Name) continue;
+
+			if (FCString::Strcmp(Name, TEXT("bo")) == 0 && !BayesOptimizer::IsAvailable())
+			{
+				// Only an error if it was asked for explicitly
+				UE_LOG(LogTemp, Warning, TEXT("OpeningBenchmark: Skipping bo, BayesOpt is not available on this platform"));
+				if (Algorithm != TEXT("all")) Result = 1;
+				continue;
+			}
+
+			if (!RunBenchmark(Engine, Name, Steps, LevelName)) Result = 1;
+		}
+
+		Engine->m_enable_checkpoint = enable_checkpoint;
+		Engine->m_enable_eval_cache = enable_eval_cache;
+		Engine->SetObjectiveEvaluator(nullptr);
+	}
+
+	World->DestroyWorld(false);
+	World->RemoveFromRoot();
+
+	return Result;
+}
+
+bool UOpeningBenchmarkCommandlet::RunBenchmark(AOpeningEngine* Engine, const FString& Algorithm, int Steps, const FString& MapName)
+{
+	// -steps only applies to this run, every algorithm starts from the level settings
+	const int max_optimization_steps = Engine->m_max_optimization_steps;
+	const int explore_steps = Engine->m_explore_steps;
+	ON_SCOPE_EXIT
+	{
+		Engine->m_max_optimization_steps = max_optimization_steps;
+		Engine->m_explore_steps = explore_steps;
+	};
+
+	if (Steps > 0)
+	{
+		Engine->m_max_optimization_steps = Steps;
+		Engine->m_explore_steps = Steps;
+	}
+
+	const double start = FPlatformTime::Seconds();
+
+	if (Algorithm == TEXT("random")) Engine->StartOptimization();
+	else if (Algorithm == TEXT("sa")) Engine->StartOptimizationSA();
+	else Engine->StartBayesOptimization();
+
+	if (!Engine->m_enable_optimization)
+	{
+		UE_LOG(LogTemp, Error, TEXT("OpeningBenchmark: Cannot start %s"), *Algorithm);
+		return false;
+	}
+
+	// Best loss after every optimization step
+	TArray<float> best_loss;
+	int last_count = Engine->m_current_optimization_count;
+	while (Engine->m_enable_optimization)
+	{
+		Engine->MainLoop(0.f);
+		if (Engine->m_current_optimization_count != last_count && Engine->m_enable_optimization)
+		{
+			last_count = Engine->m_current_optimization_count;
+			best_loss.Add(Engine->m_opt_state.best_loss);
+		}
+	}
+
+	const double elapsed_time = FPlatformTime::Seconds() - start;
+	UE_LOG(LogTemp, Display, TEXT("OpeningBenchmark: %s - %d steps in %.3f s (%.1f steps/s), best loss %.4f"),
+		*Algorithm, best_loss.Num(), elapsed_time, best_loss.Num() / FMath::Max(elapsed_time, 1e-9),
+		Engine->m_opt_state.best_loss);
+
+	TArray<FString> lines = { TEXT("iteration,best_loss") };
+	for (int i = 0; i < best_loss.Num(); ++i)
+		lines.Add(FString::Printf(TEXT("%d,%f"), i + 1, best_loss[i]));
+
+	const FString path = FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("Benchmark"), MapName + TEXT("_") + Algorithm + TEXT(".csv"));
+	if (!FFileHelper::SaveStringArrayToFile(lines, *path))
+	{
+		UE_LOG(LogTemp, Error, TEXT("OpeningBenchmark: Cannot write %s"), *path);
+		return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,44 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+
+#include "OpeningBenchmarkCommandlet.generated.h"
+
+/*
+	Headless benchmark of the opening optimizers. Loads a level, replaces the samplers
+	of its Opening Engine with an analytic evaluator and runs the optimization loop
+	without rendering:
+
+	UnrealEditor-Cmd LotusTestBed.uproject -run=OpeningBenchmark -map=/Game/Maps/Room
+		[-algorithm=random|sa|bo|all] [-evaluator=daylight|pointsource] [-steps=N] [-cache]
+		-nullrhi -unattended
+
+	Writes the best loss per iteration to Saved/Benchmark/<level>_<algorithm>.csv
+
+	It needs an editor build of the project (UnrealEditor-Cmd, the level is loaded
+	from its source assets) but no GPU (-nullrhi), so it also runs on Linux build
+	machines with the editor compiled from source:
+
+	Engine/Binaries/Linux/UnrealEditor-Cmd LotusTestBed.uproject -run=OpeningBenchmark
+		-map=/Game/Maps/Room -algorithm=all -nullrhi -unattended -nopause
+
+	BayesOpt is only prebuilt for Windows, so bo is skipped elsewhere (an error if it
+	is requested with -algorithm=bo). -steps and the checkpoint and cache settings of
+	the engine are restored once the benchmark is done.
+*/
+UCLASS()
+class LOTUSTESTBED_API UOpeningBenchmarkCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+	UOpeningBenchmarkCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+
+private:
+	bool RunBenchmark(class AOpeningEngine* Engine, const FString& Algorithm, int Steps, const FString& MapName);
+};
@@ -350,6 +350,23 @@ bool AOpeningDomain::ResetCutted()
 	return ok;	
 }
 
+void AOpeningDomain::GetCuttedGeometries(TArray<ACuttedDynamicGeometry*>& Geometries)
+{
+	if (CuttedMesh != nullptr)
+	{
+		Geometries.AddUnique(CuttedMesh.Get());
+	}
+
+	for (auto inst : m_instanced_domains)
+	{
+		inst->GetCuttedGeometries(Geometries);
+	}
+	for (auto inst : m_domains)
+	{
+		inst->GetCuttedGeometries(Geometries);
+	}
+}
+
 int AOpeningDomain::GetNumberOfVariables()
 {
 	int number = 2; // Position XY
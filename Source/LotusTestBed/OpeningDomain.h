@@ -108,6 +108,9 @@ public:
 	// Reset the Cutted Geometries
 	bool ResetCutted();
 
+	// Collect the Cutted Geometries of this domain, its instances and neighbors
+	void GetCuttedGeometries(TArray<class ACuttedDynamicGeometry*>& Geometries);
+
 	void BuildDebugTexture(const TArray<double>& Data, int RowSize);
 private:
 
@@ -6,6 +6,7 @@
 #include "ViewSampler.h"
 #include "OpeningDomain.h"
 #include "CuttedDynamicGeometry.h"
+#include "DaylightFactorEvaluator.h"
 #include "CoreGlobals.h"
 
 #include "EngineUtils.h"
@@ -13,10 +14,18 @@
 #include "Engine/SkyLight.h"
 #include "Engine/TextureCube.h"
 #include "Components/SkyLightComponent.h"
+#include "Components/SceneCaptureComponent2D.h"
+#include "HAL/FileManager.h"
+#include "Hash/CityHash.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Serialization/BufferArchive.h"
+#include "Serialization/MemoryReader.h"
 
 #include <assert.h>
 #include <numeric>
 #include <fstream>
+#include <sstream>
 
 //#define DEBUG_EXEC
 
@@ -55,6 +64,44 @@ constexpr float mapPosX(float x, float domain_selected, const float domain_num)
 	return (domain_selected + x) / domain_num;
 }
 
+// Checkpoint format
+constexpr uint32 CHECKPOINT_MAGIC = 0x4B43444F; // "ODCK"
+constexpr int32 CHECKPOINT_VERSION = 2;
+
+// Evaluation cache format
+constexpr uint32 EVAL_CACHE_MAGIC = 0x4345444F; // "ODEC"
+constexpr int32 EVAL_CACHE_VERSION = 2;
+
+FArchive& operator<<(FArchive& Ar, FOptimizationOpeningState& State)
+{
+	Ar << State.parameters;
+	Ar << State.domainIndex;
+	return Ar;
+}
+
+FArchive& operator<<(FArchive& Ar, FSamplerPair& Pair)
+{
+	// Samplers are restored by index, see SerializeCheckpoint
+	Ar << Pair.Value;
+	return Ar;
+}
+
+FArchive& operator<<(FArchive& Ar, FOpeningPair& Pair)
+{
+	Ar << Pair.cutter;
+	Ar << Pair.cost;
+	Ar << Pair.loss;
+	Ar << Pair.penalty;
+	return Ar;
+}
+
+FArchive& operator<<(FArchive& Ar, FSamplerEvaluation& Evaluation)
+{
+	Ar << Evaluation.view_values;
+	Ar << Evaluation.planar_values;
+	return Ar;
+}
+
 // Sets default values
 AOpeningEngine::AOpeningEngine()
 {
@@ -96,14 +143,28 @@ bool AOpeningEngine::SetEnvMap(class UTextureCube* env_map) {
 	}
 
 	if (SkylightComponent == nullptr) return false;
+
 	if (SkylightComponent->Cubemap == env_map) return true;
 
+	// The sky capture is only updated later in the world tick, so the samplers
+	// may not render with the new cubemap before the next frame
 	SkylightComponent->SetCubemap(env_map);
-
 	return false;
 }
 
 void AOpeningEngine::MainLoop(float DeltaTime) {
+	// Stages that finish on this tick advance right away, so only waiting for the
+	// samplers or for a new sky capture spans several frames. At most one
+	// candidate is evaluated per call.
+	const int optimization_count = m_current_optimization_count;
+	for (int i = 0; i < LOTUS_STAGE_MAX && m_enable_optimization; ++i)
+	{
+		const SimulationStage previous_stage = m_stage;
+		this->AdvanceStage();
+		if (m_stage == previous_stage) break;
+		if (m_stage == LOTUS_STAGE_OPT_STEP && m_current_optimization_count != optimization_count) break;
+	}
+
 	FString stage = FString("UNKNOW");
 	switch(m_stage) {
 		case LOTUS_STAGE_INIT: stage = "Init Stage"; break;
@@ -113,10 +174,13 @@ void AOpeningEngine::MainLoop(float DeltaTime) {
 		case LOTUS_STAGE_SET_AVG_ENV_MAP: stage = "Set AVG Env Map Stage"; break;
 		case LOTUS_STAGE_VIEW_SAMPLERS: stage = "View Sampler Stage"; break;
 		case LOTUS_STAGE_PLANAR_SAMPLERS: stage = "Planar Sampler Stage"; break;
+		case LOTUS_STAGE_ALL_SAMPLERS: stage = "All Sampler Stage"; break;
 	}
 
 	GEngine->AddOnScreenDebugMessage(1, 5.f, FColor::White, FString::Printf(TEXT("Optimization Stage: %s"), *stage));
+}
 
+void AOpeningEngine::AdvanceStage() {
 	if (LOTUS_STAGE_INIT == m_stage) {
 		m_init_opt_cb();
 		m_stage = LOTUS_STAGE_OPT_STEP;
@@ -135,7 +199,10 @@ void AOpeningEngine::MainLoop(float DeltaTime) {
 	}
 	else if (LOTUS_STAGE_CSG_OPS == m_stage) {
 		m_csg_op_cb();
-		m_stage = LOTUS_STAGE_SET_MAX_ENV_MAP;
+		// Already rendered configurations skip straight to the next step,
+		// and nothing is rendered when an evaluator replaces the samplers
+		const bool skip_rendering = this->LookupEvaluation() || m_active_evaluator.IsValid();
+		m_stage = skip_rendering ? LOTUS_STAGE_OPT_STEP : LOTUS_STAGE_SET_MAX_ENV_MAP;
 	}
 	else if (LOTUS_STAGE_SET_MAX_ENV_MAP == m_stage) {
 		if (SetEnvMap(m_max_env_map)) {
@@ -144,6 +211,14 @@ void AOpeningEngine::MainLoop(float DeltaTime) {
 				vsampler->SetShouldReset(true);
 				vsampler->SetRenderingDone(false);
 			}
+			// The max env map stays set, the planar samplers are rescaled afterwards
+			if (m_sky_ratio_evaluator.IsValid()) {
+				m_stage = LOTUS_STAGE_ALL_SAMPLERS;
+				for (auto psampler : m_planar_samplers) {
+					psampler->SetShouldReset(true);
+					psampler->SetRenderingDone(false);
+				}
+			}
 		}
 	}
 	else if (LOTUS_STAGE_SET_AVG_ENV_MAP == m_stage) {
@@ -171,6 +246,28 @@ void AOpeningEngine::MainLoop(float DeltaTime) {
 		if (all_planar_samplers_done)
 			m_stage = LOTUS_STAGE_OPT_STEP;
 	}
+	else if (LOTUS_STAGE_ALL_SAMPLERS == m_stage) {
+		bool all_samplers_done = true;
+		for (const auto vsampler : m_view_samplers) {
+			all_samplers_done &= vsampler->GetRenderingDone();
+		}
+		for (const auto psampler : m_planar_samplers) {
+			all_samplers_done &= psampler->GetRenderingDone();
+		}
+		if (all_samplers_done)
+		{
+			m_stage = LOTUS_STAGE_OPT_STEP;
+
+			// Keep the rescaled values and render the planar samplers again, as in two-pass rendering
+			m_validating_single_pass = m_single_pass_validation_steps > 0 && m_current_optimization_count > 0 &&
+				m_current_optimization_count % m_single_pass_validation_steps == 0;
+			if (m_validating_single_pass)
+			{
+				this->GetPlanarSamplerValues(m_single_pass_planar_values);
+				m_stage = LOTUS_STAGE_SET_AVG_ENV_MAP;
+			}
+		}
+	}
 }
 
 // Called every frame
@@ -554,6 +651,10 @@ double AOpeningEngine::Loss(double YtrueMin, double YtrueMax, double Ytest)
 
 void AOpeningEngine::StopOptimization()
 {
+	Optimizer.WaitForAsync();
+	this->DiscardStagedCandidate();
+	this->SaveEvaluationCache();
+
 	m_enable_optimization = false;
 	m_current_optimization_count = 0;
 	m_stage = LOTUS_STAGE_INIT;
@@ -563,6 +664,13 @@ void AOpeningEngine::StartBayesOptimization()
 {
 	SELECTED_ALGORITHM = ALGORITHM::GAUSSIAN_PROCESS;
 
+	if (!BayesOptimizer::IsAvailable())
+	{
+		UE_LOG(LogTemp, Error, TEXT("OpeningDesign: Bayesian optimization needs the BayesOpt library, which is only built for Windows"));
+		m_enable_optimization = false;
+		return;
+	}
+
 	m_enable_optimization = this->PrepareOptimizationComponents();
 	if (!m_enable_optimization) return;
 
@@ -608,6 +716,10 @@ void AOpeningEngine::StartBayesOptimization()
 		m_global_num_of_dims = 0;
 		m_opt_state.top_k_openings.SetNum(Top_k);
 
+		m_pending_candidates.Empty();
+		m_batch_X.Empty();
+		m_batch_Y.Empty();
+
 		Optimizer.SetTrainIterations(m_train_steps);
 		Optimizer.SetIterations(m_max_optimization_steps);
 		Optimizer.SetRelearnIterations(m_relearn_steps);
@@ -622,6 +734,8 @@ void AOpeningEngine::StartBayesOptimization()
 		Optimizer.SetKernelPrior(m_kernel_prior);
 		Optimizer.SetKernelMethod(m_kernel_method);
 		Optimizer.SetSurrogateMethod(m_surrogate_method);
+		Optimizer.SetInitialDesign(m_initial_design);
+		Optimizer.SetInitialDesignBudget(m_initial_design_budget);
 		Optimizer.SetStudentParams(m_nig_params);
 		Optimizer.SetLearnAll(Learn_all);
 		Optimizer.InitOptimizer(number_of_opt_variables);
@@ -633,8 +747,19 @@ void AOpeningEngine::StartBayesOptimization()
 		// Waiting for the first CG operation
 		if (m_current_optimization_count == 0) { return; }
 
+		// The acquisition ran while the samplers were rendering
+		Optimizer.WaitForAsync();
+
 		if (m_current_optimization_count == m_max_optimization_steps)
 		{
+			// Observations of an unfinished batch
+			if (m_batch_X.Num() > 0)
+			{
+				Optimizer.ReFitModelBatch(m_batch_X, m_batch_Y);
+				m_batch_X.Empty();
+				m_batch_Y.Empty();
+			}
+
 			TArray<double> sampleX;
 			double sampleY = 0;
 			Optimizer.GetOptimum(sampleX, &sampleY);
@@ -665,23 +790,37 @@ void AOpeningEngine::StartBayesOptimization()
 				TArray<double> sampleX;
 				double sampleY = 0;
 				this->BuildBayesOptDataPoint(sampleX, &sampleY);
-				double elapsed_time = Optimizer.ReFitModel(sampleX, sampleY);
-				//m_opt_state.Total_time_in_seconds += elapsed_time;
+				m_batch_X.Add(sampleX);
+				m_batch_Y.Add(sampleY);
+
+				// Refit once all the candidates of the batch are rendered. The
+				// asynchronous acquisition refits in the background instead.
+				if (m_pending_candidates.Num() == 0 && !m_async_acquisition)
+				{
+					double elapsed_time = Optimizer.ReFitModelBatch(m_batch_X, m_batch_Y);
+					//m_opt_state.Total_time_in_seconds += elapsed_time;
+					m_batch_X.Empty();
+					m_batch_Y.Empty();
 
 #ifdef DEBUG_EXEC
-				UE_LOG(LogTemp, Warning, TEXT("BayesOpt refitting: %.2f"), elapsed_time);
+					UE_LOG(LogTemp, Warning, TEXT("BayesOpt refitting: %.2f"), elapsed_time);
 #endif
+				}
 			}
 		}
+
+		if (m_current_optimization_count % FMath::Max(m_checkpoint_interval, 1) == 0)
+		{
+			this->SaveCheckpoint();
+		}
 	};
 
 	m_csg_op_cb = [&]()
 	{
-		this->ResetDomains();
-
 		if (m_current_optimization_count == m_max_optimization_steps)
 		{
 			// Optimum was set on the previous tick
+			this->ResetDomains();
 			FinalizeOpenings();
 		}
 		else if (m_current_optimization_count < m_train_steps) 
@@ -689,27 +828,398 @@ void AOpeningEngine::StartBayesOptimization()
 			TArray<double> sampleX;
 			Optimizer.GetTrainStep(sampleX, m_current_optimization_count);
 			this->BuildCutterDataPoint(m_opt_state.previous_cutter, sampleX);
-			this->ApplyCutterTransforms(m_opt_state.previous_cutter);
+			this->ApplyCandidate(sampleX);
 			//this->SampleOpeningDomain(true);
+
+			// The next training sample is cut while this one renders
+			if (m_current_optimization_count + 1 < m_train_steps)
+			{
+				TArray<double> nextX;
+				Optimizer.GetTrainStep(nextX, m_current_optimization_count + 1);
+				this->StageCandidate(nextX);
+			}
 		}
 		else if (m_current_optimization_count > m_train_steps) // Explore state
 		{
-			TArray<double> sampleX;
-			double elapsed_time = Optimizer.GetNextStep(sampleX);
-			//m_opt_state.Total_time_in_seconds += elapsed_time;
+			if (m_pending_candidates.Num() == 0)
+			{
+				const int batch_size = FMath::Min(m_batch_size,
+					m_max_optimization_steps - m_current_optimization_count);
+				double elapsed_time = 0;
+				if (Optimizer.IsAsyncPending())
+				{
+					elapsed_time = Optimizer.EndNextStepsAsync(m_pending_candidates);
+				}
+				else
+				{
+					// Observations not fitted by a background acquisition (e.g. resumed run)
+					if (m_batch_X.Num() > 0)
+					{
+						Optimizer.ReFitModelBatch(m_batch_X, m_batch_Y);
+						m_batch_X.Empty();
+						m_batch_Y.Empty();
+					}
+					elapsed_time = Optimizer.GetNextSteps(FMath::Max(batch_size, 1), m_pending_candidates);
+				}
+				//m_opt_state.Total_time_in_seconds += elapsed_time;
 
 #ifdef DEBUG_EXEC
-			UE_LOG(LogTemp, Warning, TEXT("BayesOpt nextStep: %.2f"), elapsed_time);
+				UE_LOG(LogTemp, Warning, TEXT("BayesOpt nextStep: %.2f"), elapsed_time);
 #endif
+			}
+
+			TArray<double> sampleX = m_pending_candidates[0];
+			m_pending_candidates.RemoveAt(0);
 			this->BuildCutterDataPoint(m_opt_state.previous_cutter, sampleX);
 			//this->LogArray(FString("BayesOpt next step: "), sampleX);
-			this->ApplyCutterTransforms(m_opt_state.previous_cutter);
+			this->ApplyCandidate(sampleX);
+
+			// The next candidate of the batch is cut while this one renders
+			if (m_pending_candidates.Num() > 0)
+			{
+				this->StageCandidate(m_pending_candidates[0]);
+			}
+
+			// Once the last candidate of the batch is set, the next batch is computed
+			// while it renders, believing the prediction at the candidate. The
+			// observations gathered so far are fitted first.
+			const int remaining_steps = m_max_optimization_steps - m_current_optimization_count - 1;
+			if (m_async_acquisition && m_pending_candidates.Num() == 0 && remaining_steps > 0)
+			{
+				Optimizer.BeginNextStepsAsync(FMath::Min(m_batch_size, remaining_steps),
+					m_batch_X, m_batch_Y, { sampleX });
+				m_batch_X.Empty();
+				m_batch_Y.Empty();
+			}
+		}
+		else
+		{
+			this->ResetDomains();
 		}
 
 		++m_current_optimization_count;
 	};
 }
 
+void AOpeningEngine::ResumeOptimization()
+{
+	TArray<uint8> Data;
+	if (!FFileHelper::LoadFileToArray(Data, *this->GetCheckpointPath()))
+	{
+		UE_LOG(LogTemp, Error, TEXT("OpeningDesign: Cannot read checkpoint %s"), *this->GetCheckpointPath());
+		return;
+	}
+
+	FMemoryReader Ar(Data);
+	uint32 magic = 0;
+	int32 version = 0;
+	Ar << magic;
+	Ar << version;
+	if (magic != CHECKPOINT_MAGIC || version != CHECKPOINT_VERSION)
+	{
+		UE_LOG(LogTemp, Error, TEXT("OpeningDesign: Invalid checkpoint file"));
+		return;
+	}
+
+	// The schedule of the stored run replaces the one in the UI
+	Ar << m_train_steps;
+	Ar << m_explore_steps;
+
+	this->StartBayesOptimization();
+	if (!m_enable_optimization) return;
+
+	m_init_opt_cb();
+	if (!this->SerializeCheckpoint(Ar) || Ar.IsError())
+	{
+		UE_LOG(LogTemp, Error, TEXT("OpeningDesign: Checkpoint does not match the current scene"));
+		this->StopOptimization();
+		return;
+	}
+
+	// The model is fitted once the training samples are gathered. The C API does not
+	// expose the kernel hyperparameters, so they are not stored: the fit relearns them
+	// from the stored samples, and the relearn schedule restarts from here.
+	if (m_current_optimization_count > m_train_steps)
+	{
+		Optimizer.FitModel();
+		UE_LOG(LogTemp, Warning, TEXT("OpeningDesign: Kernel hyperparameters relearnt on resume"));
+	}
+
+	UE_LOG(LogTemp, Warning, TEXT("OpeningDesign: Resuming at iteration %d"), m_current_optimization_count);
+	m_stage = LOTUS_STAGE_CSG_OPS;
+}
+
+FString AOpeningEngine::GetCheckpointPath() const
+{
+	return FPaths::Combine(FPaths::ProjectSavedDir(), m_checkpoint_file);
+}
+
+void AOpeningEngine::SaveCheckpoint()
+{
+	if (!m_enable_checkpoint) return;
+
+	FBufferArchive Ar;
+	uint32 magic = CHECKPOINT_MAGIC;
+	int32 version = CHECKPOINT_VERSION;
+	Ar << magic;
+	Ar << version;
+	Ar << m_train_steps;
+	Ar << m_explore_steps;
+	this->SerializeCheckpoint(Ar);
+
+	// Write and rename, so a crash while saving keeps the previous checkpoint
+	const FString path = this->GetCheckpointPath();
+	const FString tmp_path = path + TEXT(".tmp");
+	if (!FFileHelper::SaveArrayToFile(Ar, *tmp_path) ||
+		!IFileManager::Get().Move(*path, *tmp_path))
+	{
+		UE_LOG(LogTemp, Error, TEXT("OpeningDesign: Cannot write checkpoint %s"), *path);
+	}
+}
+
+bool AOpeningEngine::SerializeCheckpoint(FArchive& Ar)
+{
+	const int num_cutters = m_opt_state.previous_cutter.Num();
+	const int num_view_samplers = m_opt_state.per_view_sampler_cost.Num();
+	const int num_planar_samplers = m_opt_state.per_planar_sampler_cost.Num();
+
+	Ar << m_current_optimization_count;
+	Ar << m_opt_state.best_loss;
+	Ar << m_opt_state.best_cost;
+	Ar << m_opt_state.best_penalty;
+
+	// Total_time_in_seconds holds the start time while optimizing
+	double elapsed_time = FPlatformTime::Seconds() - m_opt_state.Total_time_in_seconds;
+	Ar << elapsed_time;
+	m_opt_state.Total_time_in_seconds = FPlatformTime::Seconds() - elapsed_time;
+
+	Ar << m_opt_state.per_view_sampler_cost;
+	Ar << m_opt_state.per_planar_sampler_cost;
+	Ar << m_opt_state.top_k_openings;
+	Ar << m_opt_state.best_cutter;
+	Ar << m_opt_state.previous_cutter;
+
+	Ar << m_pending_candidates;
+	Ar << m_batch_X;
+	Ar << m_batch_Y;
+
+	FString random_state;
+	if (Ar.IsSaving())
+	{
+		std::ostringstream stream;
+		stream << m_random_generator;
+		random_state = UTF8_TO_TCHAR(stream.str().c_str());
+	}
+	Ar << random_state;
+
+	Optimizer.Serialize(Ar);
+
+	if (Ar.IsLoading())
+	{
+		std::istringstream stream(TCHAR_TO_UTF8(*random_state));
+		stream >> m_random_generator;
+
+		if (m_opt_state.previous_cutter.Num() != num_cutters ||
+			m_opt_state.per_view_sampler_cost.Num() != num_view_samplers ||
+			m_opt_state.per_planar_sampler_cost.Num() != num_planar_samplers)
+		{
+			return false;
+		}
+
+		for (int i = 0; i < m_view_samplers.Num(); ++i)
+		{
+			m_opt_state.per_view_sampler_cost[i].Sampler = m_view_samplers[i];
+		}
+
+		for (int i = 0; i < m_planar_samplers.Num(); ++i)
+		{
+			m_opt_state.per_planar_sampler_cost[i].Sampler = m_planar_samplers[i];
+		}
+	}
+
+	return true;
+}
+
+FString AOpeningEngine::GetEvaluationCachePath() const
+{
+	const FString map_name = UWorld::RemovePIEPrefix(GetWorld()->GetMapName());
+	return FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("EvaluationCache"), map_name + TEXT(".bin"));
+}
+
+uint64 AOpeningEngine::GetEvaluationSceneHash() const
+{
+	// Everything but the cutter parameters that changes the sampler values
+	FBufferArchive Ar;
+	FString max_env_map = GetPathNameSafe(m_max_env_map);
+	FString avg_env_map = GetPathNameSafe(m_avg_env_map);
+	FString evaluator = m_active_evaluator.IsValid() ? m_active_evaluator->GetName() : FString();
+	float light_efficacy = m_light_efficacy;
+	bool approximate_planar = m_sky_ratio_evaluator.IsValid();
+	Ar << max_env_map;
+	Ar << avg_env_map;
+	Ar << evaluator;
+	Ar << light_efficacy;
+	Ar << approximate_planar;
+
+	auto AddSampler = [&Ar](ASceneCapture2D* sampler)
+	{
+		FTransform transform = sampler->GetActorTransform();
+		int32 spp = sampler->GetCaptureComponent2D()->PostProcessSettings.PathTracingSamplesPerPixel;
+		Ar << transform;
+		Ar << spp;
+	};
+	for (AViewSampler* sampler : m_view_samplers) AddSampler(sampler);
+	for (APlanarSampler* sampler : m_planar_samplers) AddSampler(sampler);
+
+	for (AOpeningDomain* domain : m_opening_domains)
+	{
+		FTransform transform = domain->GetActorTransform();
+		FTransform cutted_transform = domain->CuttedMesh->GetActorTransform();
+		float cutter_depth = domain->CuttedMesh->m_cutter_depth;
+		uint8 cutter_type = static_cast<uint8>(domain->m_cutter_type);
+		uint8 opening_type = static_cast<uint8>(domain->m_opening_type);
+		uint8 scale_optimization = static_cast<uint8>(domain->m_scale_optimization);
+		int32 number_of_cutters = domain->m_number_of_cutters;
+		FVector2f cutter_scale_x = domain->m_cutter_scaleX;
+		FVector2f cutter_scale_y = domain->m_cutter_scaleY;
+		Ar << transform;
+		Ar << cutted_transform;
+		Ar << cutter_depth;
+		Ar << cutter_type;
+		Ar << opening_type;
+		Ar << scale_optimization;
+		Ar << number_of_cutters;
+		Ar << cutter_scale_x;
+		Ar << cutter_scale_y;
+	}
+
+	return CityHash64(reinterpret_cast<const char*>(Ar.GetData()), Ar.Num());
+}
+
+uint64 AOpeningEngine::GetEvaluationKey(const TArray<FOptimizationOpeningState>& Cutters) const
+{
+	TArray<int32> key;
+	key.Add(static_cast<int32>(m_evaluation_scene_hash));
+	key.Add(static_cast<int32>(m_evaluation_scene_hash >> 32));
+
+	for (const auto& cutter : Cutters)
+	{
+		key.Add(cutter.domainIndex);
+		for (float parameter : cutter.parameters)
+			key.Add(FMath::RoundToInt(parameter * m_cache_quantization));
+	}
+
+	return CityHash64(reinterpret_cast<const char*>(key.GetData()), key.Num() * sizeof(int32));
+}
+
+void AOpeningEngine::GetPlanarSamplerValues(TArray<double>& Values)
+{
+	Values.Reset(m_planar_samplers.Num());
+	for (auto psampler : m_planar_samplers)
+		Values.Add(psampler->GetColor().illuminance.Length());
+
+	// Rendered with the max env map
+	if (m_sky_ratio_evaluator.IsValid())
+	{
+		TArray<double> ratios;
+		m_sky_ratio_evaluator->EvaluatePlanarSkyRatios(m_opening_domains, ratios);
+		for (int i = 0; i < Values.Num(); ++i)
+			Values[i] *= ratios[i];
+	}
+}
+
+bool AOpeningEngine::LookupEvaluation()
+{
+	m_has_cache_hit = false;
+
+	// The final configuration is always rendered
+	if (!m_enable_eval_cache || m_current_optimization_count > m_max_optimization_steps)
+		return false;
+
+	const FSamplerEvaluation* evaluation = m_evaluation_cache.Find(this->GetEvaluationKey(m_opt_state.previous_cutter));
+	if (evaluation == nullptr ||
+		evaluation->view_values.Num() != m_view_samplers.Num() ||
+		evaluation->planar_values.Num() != m_planar_samplers.Num())
+	{
+		return false;
+	}
+
+	m_cache_hit = *evaluation;
+	m_has_cache_hit = true;
+	return true;
+}
+
+void AOpeningEngine::LoadEvaluationCache()
+{
+	m_evaluation_cache.Empty();
+	m_has_cache_hit = false;
+	m_evaluation_cache_dirty = false;
+	if (!m_enable_eval_cache) return;
+
+	m_evaluation_scene_hash = this->GetEvaluationSceneHash();
+
+	TArray<uint8> Data;
+	if (!FFileHelper::LoadFileToArray(Data, *this->GetEvaluationCachePath(), FILEREAD_Silent)) return;
+
+	FMemoryReader Ar(Data);
+	uint32 magic = 0;
+	int32 version = 0;
+	int32 quantization = 0;
+	uint64 scene_hash = 0;
+	Ar << magic;
+	Ar << version;
+	Ar << quantization;
+	Ar << scene_hash;
+
+	// Entries quantized differently or of another scene setup do not match the current keys
+	if (magic != EVAL_CACHE_MAGIC || version != EVAL_CACHE_VERSION ||
+		quantization != m_cache_quantization || scene_hash != m_evaluation_scene_hash)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("OpeningDesign: Discarding incompatible evaluation cache"));
+		return;
+	}
+
+	Ar << m_evaluation_cache;
+	if (Ar.IsError())
+	{
+		m_evaluation_cache.Empty();
+		return;
+	}
+
+	UE_LOG(LogTemp, Warning, TEXT("OpeningDesign: Loaded %d cached evaluations"), m_evaluation_cache.Num());
+}
+
+void AOpeningEngine::SaveEvaluationCache()
+{
+	if (!m_evaluation_cache_dirty) return;
+	m_evaluation_cache_dirty = false;
+
+	FBufferArchive Ar;
+	uint32 magic = EVAL_CACHE_MAGIC;
+	int32 version = EVAL_CACHE_VERSION;
+	int32 quantization = m_cache_quantization;
+	uint64 scene_hash = m_evaluation_scene_hash;
+	Ar << magic;
+	Ar << version;
+	Ar << quantization;
+	Ar << scene_hash;
+	Ar << m_evaluation_cache;
+
+	const FString path = this->GetEvaluationCachePath();
+	if (!FFileHelper::SaveArrayToFile(Ar, *path))
+	{
+		UE_LOG(LogTemp, Error, TEXT("OpeningDesign: Cannot write evaluation cache %s"), *path);
+	}
+}
+
+void AOpeningEngine::ClearEvaluationCache()
+{
+	m_evaluation_cache.Empty();
+	m_has_cache_hit = false;
+	m_evaluation_cache_dirty = false;
+	IFileManager::Get().Delete(*this->GetEvaluationCachePath(), false, false, true);
+}
+
 void AOpeningEngine::StartDebugBayesCostFunction()
 {
 	FindSamplers();
@@ -772,26 +1282,26 @@ void AOpeningEngine::TickDebugBayesFunction()
 
 	if (!m_enable_optimization)
 	{
+		int dim = m_num_samples;
 		if (m_current_sample == 0)
 		{
+			// The model no longer changes once the optimization has stopped,
+			// so the whole response surface is evaluated once per sweep
+			TArray<double> samplesX;
+			samplesX.SetNum(2 * dim * dim);
+			for (int sample_i = 0; sample_i < dim * dim; ++sample_i)
+			{
+				samplesX[2 * sample_i] = (sample_i / dim) / float(dim);
+				samplesX[2 * sample_i + 1] = (sample_i % dim) / float(dim);
+			}
+			Optimizer.GetResponseSurfaceBatch(samplesX, PredLossValues);
+
 			++m_current_sample;
 			this->DebugSetCutter();
 			return;
 		}
 
 		int prev_sample = m_current_sample - 1;
-		int dim = m_num_samples;
-		int x = prev_sample / dim;
-		int y = prev_sample % dim;
-
-		float fx = x / float(dim);
-		float fy = y / float(dim);
-
-		TArray<double> sampleX;
-		sampleX.SetNum(2);
-		sampleX[0] = fx;
-		sampleX[1] = fy;
-		//Optimizer.GetResponseSurfaceAt(sampleX, &PredLossValues[prev_sample]);
 		UE_LOG(LogTemp, Warning, TEXT("OpeningDesign: %d - %.1f"), prev_sample, PredLossValues[prev_sample]);
 		++m_current_sample;
 		this->DebugSetCutter();
@@ -846,6 +1356,39 @@ bool AOpeningEngine::PrepareOptimizationComponents()
 		return false;
 	}
 
+	// An evaluator set by the caller takes precedence over the daylight proxy
+	m_active_evaluator = m_evaluator;
+	if (!m_active_evaluator.IsValid() && m_use_daylight_proxy)
+		m_active_evaluator = MakeShared<FDaylightFactorEvaluator>(m_max_env_map, m_avg_env_map, m_light_efficacy);
+	if (m_active_evaluator.IsValid())
+	{
+		UE_LOG(LogTemp, Warning, TEXT("OpeningDesign: Evaluating with %s"), *m_active_evaluator->GetName());
+		m_active_evaluator->Prepare(m_opening_domains, m_view_samplers, m_planar_samplers);
+	}
+
+	// Both sampler classes render in one stage under the max env map
+	m_sky_ratio_evaluator.Reset();
+	if (!m_active_evaluator.IsValid() && m_single_pass_rendering && m_max_env_map != m_avg_env_map)
+	{
+		m_sky_ratio_evaluator = MakeShared<FDaylightFactorEvaluator>(m_max_env_map, m_avg_env_map, m_light_efficacy);
+		m_sky_ratio_evaluator->Prepare(m_opening_domains, m_view_samplers, m_planar_samplers);
+
+		// Without the env map radiance (cooked builds) every ratio would be 1
+		if (!m_sky_ratio_evaluator->HasSkyData())
+		{
+			UE_LOG(LogTemp, Error, TEXT("OpeningDesign: Env map source data is unavailable, falling back to two-pass rendering"));
+			m_sky_ratio_evaluator.Reset();
+		}
+		else
+		{
+			UE_LOG(LogTemp, Warning, TEXT("OpeningDesign: Single pass rendering, the planar values are rescaled without occlusion"));
+			if (GEngine)
+				GEngine->AddOnScreenDebugMessage(INDEX_NONE, 10.f, FColor::Yellow, TEXT("OpeningDesign: Single pass rendering, planar values are approximate"));
+		}
+	}
+	m_single_pass_planar_values.Reset();
+	m_validating_single_pass = false;
+
 	// Find the cutters in the scene
 	if (m_opening_domains.IsEmpty())
 	{
@@ -881,11 +1424,15 @@ bool AOpeningEngine::PrepareOptimizationComponents()
 #endif
 	}
 
+	this->LoadEvaluationCache();
+
 	return true;
 }
 
 void AOpeningEngine::ResetDomains()
 {
+	this->DiscardStagedCandidate();
+
 	// Reset openings
 	for (int32 i = 0; i < m_opening_domains.Num(); ++i)
 	{
@@ -996,11 +1543,57 @@ float AOpeningEngine::EvaluateLoss()
 	TArray<FSamplerPair> per_view_sampler_cost = m_opt_state.per_view_sampler_cost;
 	TArray<FSamplerPair> per_planar_sampler_cost = m_opt_state.per_planar_sampler_cost;
 
+	// Values of this configuration, from the cache, the evaluator or the samplers
+	FSamplerEvaluation evaluation;
+	const bool from_cache = m_has_cache_hit;
+	if (from_cache)
+	{
+		evaluation = MoveTemp(m_cache_hit);
+		m_has_cache_hit = false;
+	}
+	else if (m_active_evaluator.IsValid())
+	{
+		m_active_evaluator->Evaluate(m_opening_domains, m_view_samplers, m_planar_samplers, evaluation);
+	}
+	else
+	{
+		for (auto vsampler : m_view_samplers)
+			evaluation.view_values.Add(vsampler->GetColor().maxValue.Length());
+		if (m_validating_single_pass)
+		{
+			// The objective stays the single pass one, the second pass only measures its error
+			double max_error = 0;
+			for (int i = 0; i < m_planar_samplers.Num(); ++i)
+			{
+				const double rendered = m_planar_samplers[i]->GetColor().illuminance.Length();
+				const double error = FMath::Abs(m_single_pass_planar_values[i] - rendered) / FMath::Max(rendered, 1e-6);
+				max_error = FMath::Max(max_error, error);
+			}
+			evaluation.planar_values = MoveTemp(m_single_pass_planar_values);
+			m_validating_single_pass = false;
+
+			UE_LOG(LogTemp, Warning, TEXT("OpeningDesign: Single pass planar error at %d iter: %.1f%%"), m_current_optimization_count, max_error * 100.0);
+			if (GEngine)
+				GEngine->AddOnScreenDebugMessage(3, 10.f, max_error > 0.1 ? FColor::Red : FColor::Yellow,
+					FString::Printf(TEXT("Single pass planar error: %.1f%%"), max_error * 100.0));
+		}
+		else
+		{
+			this->GetPlanarSamplerValues(evaluation.planar_values);
+		}
+	}
+
+	// Nothing is rendered before the first CSG operation
+	if (!from_cache && m_enable_eval_cache && m_enable_optimization && m_current_optimization_count > 0)
+	{
+		m_evaluation_cache.Add(this->GetEvaluationKey(m_opt_state.previous_cutter), evaluation);
+		m_evaluation_cache_dirty = true;
+	}
+
 	for (int i = 0; i < m_view_samplers.Num(); ++i)
 	{
-		AViewSampler::RetColorStats stats = m_view_samplers[i]->GetColor();
 		auto goal = m_view_samplers[i]->m_illumination_goal;
-		double sampler_value = stats.maxValue.Length();
+		double sampler_value = evaluation.view_values[i];
 		double view_loss = this->Loss(goal.min_value, goal.max_value, sampler_value);
 		
 		//UE_LOG(LogTemp, Warning, TEXT("OpeningDesign: View[%d] Color %.2f %.2f %.2f"), i, stats.average.X, stats.average.Y, stats.average.Z);
@@ -1011,10 +1604,9 @@ float AOpeningEngine::EvaluateLoss()
 
 	for (int i = 0; i < m_planar_samplers.Num(); ++i)
 	{
-		APlanarSampler::RetColorStats stats = m_planar_samplers[i]->GetColor();
 		auto goal = m_planar_samplers[i]->m_illumination_goal;
 
-		double sampler_value = stats.illuminance.Length();
+		double sampler_value = evaluation.planar_values[i];
 		double planar_loss = this->Loss(goal.min_value, goal.max_value, sampler_value);
 		per_planar_sampler_cost[i].Value = { sampler_value, planar_loss };
 		//UE_LOG(LogTemp, Warning, TEXT("OpeningDesign: Planar[%d] Illuminance: %.4f - %.4f, %.1f %.1f"), i, stats.illuminance.Length(), planar_loss, goal.min_value, goal.max_value);
@@ -1025,9 +1617,9 @@ float AOpeningEngine::EvaluateLoss()
 	float penalty = m_penalty_multiplier * this->EvaluateOverlapLoss();
 	float sum_loss = sampler_loss + penalty;
 
-	UE_LOG(LogTemp, Error, TEXT("OpeningDesign: Iter: %d - Loss: %.2f Penalty: %.2f"),
+	UE_LOG(LogTemp, Error, TEXT("OpeningDesign: Iter: %d - Loss: %.2f Penalty: %.2f%s"),
 		m_current_optimization_count,
-		sampler_loss, penalty);
+		sampler_loss, penalty, from_cache ? TEXT(" (cached)") : TEXT(""));
 
 	// Save the best state
 	if (sum_loss < m_opt_state.best_loss)
@@ -1090,6 +1682,60 @@ void AOpeningEngine::ApplyCutterTransforms(const TArray<FOptimizationOpeningStat
 	}
 }
 
+void AOpeningEngine::ApplyCandidate(const TArray<double>& X)
+{
+	// Cut while the previous candidate was rendering
+	if (m_staged_geometries.Num() > 0 && m_staged_X == X)
+	{
+		for (auto geometry : m_staged_geometries)
+		{
+			geometry->SwapStagedCuts();
+		}
+		m_staged_geometries.Empty();
+		m_staged_X.Empty();
+		return;
+	}
+
+	this->ResetDomains();
+	this->ApplyCutterTransforms(m_opt_state.previous_cutter);
+}
+
+void AOpeningEngine::StageCandidate(const TArray<double>& X)
+{
+	if (!m_pipelined_csg) return;
+
+	this->DiscardStagedCandidate();
+
+	for (auto domain : m_opening_domains)
+	{
+		domain->GetCuttedGeometries(m_staged_geometries);
+	}
+
+	// The cutters are placed on the game thread and subtracted on worker threads
+	TArray<FOptimizationOpeningState> cutters = m_opt_state.previous_cutter;
+	this->BuildCutterDataPoint(cutters, X);
+	for (auto geometry : m_staged_geometries)
+	{
+		geometry->BeginStagedCuts();
+	}
+	this->ApplyCutterTransforms(cutters);
+	for (auto geometry : m_staged_geometries)
+	{
+		geometry->EndStagedCuts();
+	}
+	m_staged_X = X;
+}
+
+void AOpeningEngine::DiscardStagedCandidate()
+{
+	for (auto geometry : m_staged_geometries)
+	{
+		geometry->DiscardStagedCuts();
+	}
+	m_staged_geometries.Empty();
+	m_staged_X.Empty();
+}
+
 void AOpeningEngine::BuildBayesOptDataPoint(TArray<double>& X, double* Y)
 {
 	const int number_of_cutters = m_opt_state.previous_cutter.Num();
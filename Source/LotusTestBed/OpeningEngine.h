@@ -11,6 +11,7 @@
 #include "ViewSampler.h"
 #include "PlanarSampler.h"
 #include "BayesOptimizer.hpp"
+#include "ObjectiveEvaluator.h"
 
 #include <random>
 
@@ -166,6 +167,7 @@ public:
 		LOTUS_STAGE_PLANAR_SAMPLERS,
 		LOTUS_STAGE_CSG_OPS,
 		LOTUS_STAGE_OPT_STEP,
+		LOTUS_STAGE_ALL_SAMPLERS,
 		LOTUS_STAGE_MAX
 	};
 
@@ -193,6 +195,36 @@ private:
 
 	BayesOptimizer Optimizer;
 
+	// Batch acquisition: candidates waiting to be rendered and the
+	// observations waiting to be added to the model
+	TArray<TArray<double>> m_pending_candidates;
+	TArray<TArray<double>> m_batch_X;
+	TArray<double> m_batch_Y;
+
+	// Pipelined CSG: the geometries being cut for the next candidate, m_staged_X,
+	// while the current one renders
+	TArray<class ACuttedDynamicGeometry*> m_staged_geometries;
+	TArray<double> m_staged_X;
+
+	// Evaluation cache, stored per level in the Saved directory
+	TMap<uint64, FSamplerEvaluation> m_evaluation_cache;
+	FSamplerEvaluation m_cache_hit;
+	bool m_has_cache_hit = false;
+	bool m_evaluation_cache_dirty = false;
+	// Hash of the scene and evaluation settings of the cached entries
+	uint64 m_evaluation_scene_hash = 0;
+
+	// Replaces the samplers when set (headless runs)
+	TSharedPtr<IObjectiveEvaluator> m_evaluator;
+	// Evaluator of the current optimization, m_evaluator or the daylight proxy
+	TSharedPtr<IObjectiveEvaluator> m_active_evaluator;
+	// Rescales the planar samplers rendered with the max env map (single pass rendering)
+	TSharedPtr<class FDaylightFactorEvaluator> m_sky_ratio_evaluator;
+	// Rescaled planar values of the current step, compared against a second pass
+	// with the avg env map every m_single_pass_validation_steps
+	TArray<double> m_single_pass_planar_values;
+	bool m_validating_single_pass = false;
+
 	// Evaluation
 	SimulationStage m_stage = LOTUS_STAGE_INIT;
 
@@ -211,11 +243,23 @@ public:
 	UPROPERTY(EditAnywhere, Category = "Evaluation", meta = (ClampMin = 1, ToolTip = "Light Efficacy from the Environement"))
 	float m_light_efficacy = 30000;
 
+	UPROPERTY(EditAnywhere, Category = "Evaluation", DisplayName = "Use daylight proxy", meta = (ToolTip = "Approximate the samplers on the CPU instead of path tracing"))
+	bool m_use_daylight_proxy = false;
+
+	UPROPERTY(EditAnywhere, Category = "Evaluation", DisplayName = "Single pass rendering", meta = (ToolTip = "Render all the samplers with the max env map and rescale the planar ones to the avg env map. Avoids the sky recaptures, the planar values become approximate: the rescale ignores the occlusion of the sky by the scene"))
+	bool m_single_pass_rendering = false;
+
+	UPROPERTY(EditAnywhere, Category = "Evaluation", DisplayName = "Single pass validation steps", meta = (EditCondition = "m_single_pass_rendering", ClampMin = 0, ToolTip = "Every N steps the planar samplers are also rendered with the avg env map and the error of the rescaled values is reported. 0 disables it"))
+	int m_single_pass_validation_steps = 10;
+
 	/*		Optimization UI		*/
 
 	UPROPERTY(VisibleAnywhere, Category = "Optimization", DisplayName = "Is Optimizing")
 	bool m_enable_optimization = false;
 
+	UPROPERTY(EditAnywhere, Category = "Optimization", DisplayName = "Pipelined CSG", meta = (ToolTip = "Cut the next known candidate on worker threads while the current one renders. Only the training samples and the batch candidates are known ahead, the one-at-a-time explore steps are cut as before"))
+	bool m_pipelined_csg = false;
+
 	UPROPERTY(EditAnywhere, Category = "Optimization", DisplayName = "Optimization Steps", meta=(ClampMin=1, ClampMax=1000, ToolTip = "Optimization Steps"))
 	int m_max_optimization_steps = 100;
 
@@ -251,6 +295,12 @@ public:
 	UPROPERTY(EditAnywhere, Category = "Optimization|Bayesian", DisplayName = "Numbers of conseq. stack-steps before jump", meta = (ClampMin = 0, ClampMax = 1000))
 	int m_force_jump = BayesOptimizer::GetDefaultForceJumpStepIters();
 
+	UPROPERTY(EditAnywhere, Category = "Optimization|Bayesian", DisplayName = "Candidates per acquisition (q)", meta = (ClampMin = 1, ClampMax = 32, ToolTip = "Candidates rendered between model refits"))
+	int m_batch_size = BayesOptimizer::GetDefaultBatchSize();
+
+	UPROPERTY(EditAnywhere, Category = "Optimization|Bayesian", DisplayName = "Asynchronous acquisition", meta = (ToolTip = "Refit the model and compute the next candidates in the background while the current one renders"))
+	bool m_async_acquisition = BayesOptimizer::GetDefaultAsyncAcquisition();
+
 	UPROPERTY(EditAnywhere, Category = "Optimization|Bayesian", DisplayName = "Cache Top-k results", meta = (ClampMin = 1, ClampMax = 10))
 	int Top_k = 10;
 
@@ -293,6 +343,12 @@ public:
 	UPROPERTY(EditAnywhere, Category = "Optimization|Bayesian", DisplayName = "Criteria method", meta = (GetOptions = "GetCriteriaOptions"))
 	FName m_criteria_method = BayesOptimizer::CriteriaMethods()[1];
 
+	UPROPERTY(EditAnywhere, Category = "Optimization|Bayesian", DisplayName = "Initial design", meta = (GetOptions = "GetInitialDesignOptions"))
+	FName m_initial_design = BayesOptimizer::InitialDesignMethods()[0];
+
+	UPROPERTY(EditAnywhere, Category = "Optimization|Bayesian", DisplayName = "Initial design time budget (s)", meta = (ClampMin = 0, ClampMax = 60, ToolTip = "Wall clock limit of the maximin design search. 0 for no limit"))
+	float m_initial_design_budget = BayesOptimizer::GetDefaultInitialDesignBudget();
+
 	UFUNCTION(CallInEditor, Category = "Optimization", DisplayName="Start Random Optimization")
 	void StartBayesOptimization();
 
@@ -307,6 +363,29 @@ public:
 	UFUNCTION(CallInEditor, Category = "Optimization")
 	void StopOptimization();
 
+	UFUNCTION(CallInEditor, Category = "Optimization", DisplayName = "Resume Optimization")
+	void ResumeOptimization();
+
+	UPROPERTY(EditAnywhere, Category = "Optimization|Checkpoint", DisplayName = "Save checkpoints", meta = (ToolTip = "Save the Bayesian optimization state periodically"))
+	bool m_enable_checkpoint = false;
+
+	UPROPERTY(EditAnywhere, Category = "Optimization|Checkpoint", DisplayName = "Checkpoint interval", meta = (ClampMin = 1, ClampMax = 1000, ToolTip = "Optimization steps between checkpoints"))
+	int m_checkpoint_interval = 10;
+
+	UPROPERTY(EditAnywhere, Category = "Optimization|Checkpoint", DisplayName = "Checkpoint file", meta = (ToolTip = "Relative to the project Saved directory"))
+	FString m_checkpoint_file = TEXT("OpeningEngine.ckpt");
+
+	UPROPERTY(EditAnywhere, Category = "Optimization|Cache", DisplayName = "Cache evaluations", meta = (ToolTip = "Reuse the sampler values of configurations that were already rendered"))
+	bool m_enable_eval_cache = false;
+
+	UPROPERTY(EditAnywhere, Category = "Optimization|Cache", DisplayName = "Cache quantization steps", meta = (ClampMin = 16, ClampMax = 65536, ToolTip = "Parameters are rounded to multiples of 1/steps. Configurations rounded to the same values share a cache entry"))
+	int m_cache_quantization = 1024;
+
+	UFUNCTION(CallInEditor, Category = "Optimization|Cache")
+	void ClearEvaluationCache();
+
+	void SetObjectiveEvaluator(TSharedPtr<IObjectiveEvaluator> Evaluator) { m_evaluator = Evaluator; }
+
 	UFUNCTION(CallInEditor, Category = "Optimization")
 	void PrintSamplerStats();
 
@@ -362,8 +441,15 @@ public:
 		return BayesOptimizer::SurrogateMethods();
 	}
 
+	UFUNCTION(CallInEditor)
+	TArray<FName> GetInitialDesignOptions() const
+	{
+		return BayesOptimizer::InitialDesignMethods();
+	}
+
 	bool SetEnvMap(class UTextureCube* env_map);
 	void MainLoop(float DeltaTime);
+	void AdvanceStage();
 	void ResetDomains();
 	void SampleOpeningDomain(bool MutateAll);
 	void SampleOpeningDomainAG(bool MutateAll);
@@ -378,8 +464,22 @@ public:
 	void BuildCutterDataPoint(TArray<FOptimizationOpeningState>& Cutters, const TArray<double>& X);
 	void ApplyCutterTransforms();
 	void ApplyCutterTransforms(const TArray<FOptimizationOpeningState>& Cutters);
+	void ApplyCandidate(const TArray<double>& X);
+	void StageCandidate(const TArray<double>& X);
+	void DiscardStagedCandidate();
 	void CacheCutterSolution(const TArray<FOptimizationOpeningState>& Cutters, double cost);
 	void LogArray(const FString& prefix, const TArray<double>& Array);
+	FString GetCheckpointPath() const;
+	void SaveCheckpoint();
+	bool SerializeCheckpoint(FArchive& Ar);
+	FString GetEvaluationCachePath() const;
+	uint64 GetEvaluationSceneHash() const;
+	uint64 GetEvaluationKey(const TArray<FOptimizationOpeningState>& Cutters) const;
+	bool LookupEvaluation();
+	// Planar sampler values, rescaled to the avg env map with single pass rendering
+	void GetPlanarSamplerValues(TArray<double>& Values);
+	void LoadEvaluationCache();
+	void SaveEvaluationCache();
 
 	std::function<void(void)> m_init_opt_cb;
 	std::function<void(void)> m_step_opt_cb;
@@ -34,7 +34,7 @@ APlanarSampler::APlanarSampler()
 	//StaticMeshComponent = NewObject<UStaticMeshComponent>();
 	StaticMeshComponent = CreateDefaultSubobject<UStaticMeshComponent>("PlanarStaticMesh", true);
 	StaticMeshComponent->AttachToComponent(RootComponent, FAttachmentTransformRules::KeepRelativeTransform);
-	StaticMeshComponent->AddLocalTransform(FTransform(FRotator3d(90, 0, 0), FVector(10, 0, 0), FVector(1, 1, 1)));
+	StaticMeshComponent->AddLocalTransform(FTransform(FRotator3d(90, 0, 0), FVector(PLANAR_SAMPLER_OFFSET, 0, 0), FVector(1, 1, 1)));
 	//StaticMeshComponent->AddLocalTransform(FTransform(FRotator3d(90, -90, 90), FVector(10, 0, 0), FVector(1, 1, 1)));	
 	//StaticMeshComponent->AddLocalTransform(b);
 	
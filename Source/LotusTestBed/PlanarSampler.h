@@ -6,6 +6,9 @@
 #include "Engine/SceneCapture2D.h"
 #include "PlanarSampler.generated.h"
 
+// Offset of the gather plane in front of the planar sampler
+constexpr float PLANAR_SAMPLER_OFFSET = 10.f;
+
 USTRUCT(BlueprintType)
 struct FIlluminanceGoal {
 	GENERATED_BODY()
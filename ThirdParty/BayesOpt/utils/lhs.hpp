@@ -27,9 +27,8 @@
 #include "randgen.hpp"
 #include "log.hpp"
 #include "indexvector.hpp"
-#if defined (USE_SOBOL)
-#  include "sobol.hpp"
-#endif
+#include "maximin.hpp"
+#include "sobol.hpp"
 
 namespace bayesopt
 {
@@ -37,9 +36,11 @@ namespace bayesopt
   {      
     
 
-    /** \brief Selects the sampling method.  */
+    /** \brief Selects the sampling method: 1-LHS, 2-Sobol,
+     * 4-maximin LHS (see maximinLhs), other value-uniform. */
     template<class M>
-    void samplePoints(M& xPoints, int method, randEngine& mtRandom);
+    void samplePoints(M& xPoints, int method, randEngine& mtRandom,
+		      double seconds = 1.0);
 
 
     /** \brief Latin hypercube sampling
@@ -48,14 +49,23 @@ namespace bayesopt
     template<class M>
     void lhs(M& Result,randEngine& mtRandom);
 
+    /** \brief Space-filling (maximin) Latin hypercube sampling
+     * See maximinLhsGenerate. The chains are seeded from mtRandom.
+     *
+     * @param Result design, one point per row
+     * @param mtRandom random engine (seeds of the chains)
+     * @param seconds wall clock budget of the annealing, 0 no limit
+     */
+    template<class M>
+    void maximinLhs(M& Result, randEngine& mtRandom, double seconds);
+
     /** \brief Hypercube sampling based on Sobol sequences
-     * It uses the external Sobol library. Thus it do not depend on
-     * boost random.
+     * The points are written directly into the (row-major) storage of
+     * the result, scrambled with the seed (0 for no scrambling). Thus
+     * it do not depend on boost random.
      */
-#if defined (USE_SOBOL)
     template<class M>
     void sobol(M& result, long long int seed);
-#endif
 
     /** \brief Uniform hypercube sampling
      * It is used to generate a set of uniformly distributed
@@ -109,18 +119,29 @@ namespace bayesopt
 	}
     }
 
-#if defined (USE_SOBOL)
+    template<class M>
+    void maximinLhs(M& Result, randEngine& mtRandom, double seconds)
+    {
+      const size_t n = Result.size1();
+      if (n == 0) return;
+      std::vector<double*> rows(n);
+      for (size_t i = 0; i < n; ++i) rows[i] = &Result(i,0);
+
+      const double criterion = maximinLhsGenerate(&rows[0], n,
+	Result.size2(), static_cast<uint32_t>(mtRandom()), seconds);
+      FILE_LOG(logDEBUG) << "Maximin LHS criterion: " << criterion;
+    }
+
     template<class M>
     void sobol(M& result, long long int seed)
     {
       size_t nSamples = result.size1();
       size_t nDims = result.size2();
+      if (nSamples == 0) return;
 
-      double *sobol_seq = i8_sobol_generate(nDims,nSamples,seed);
-
-      std::copy(sobol_seq,sobol_seq+(nSamples*nDims),result.data().begin());
+      sobolGenerate(&result.data()[0],nSamples,nDims,nDims,
+		    static_cast<uint32_t>(seed));
     }
-#endif
 
     template<class M>
     void uniformSampling(M& Result,
@@ -139,7 +160,7 @@ namespace bayesopt
 
     template<class M>
     void samplePoints(M& xPoints, int method,
-		     randEngine& mtRandom)
+		     randEngine& mtRandom, double seconds)
     {
       if (method == 1) 
 	{
@@ -148,13 +169,13 @@ namespace bayesopt
 	}
       else if (method == 2)
 	{
-#if defined (USE_SOBOL)
 	  FILE_LOG(logINFO) << "Sobol sampling";
-	  sobol(xPoints, 0);
-#else
-	  FILE_LOG(logINFO) << "Latin hypercube sampling";
-	  lhs(xPoints, mtRandom);
-#endif
+	  sobol(xPoints, mtRandom());
+	}
+      else if (method == 4)
+	{
+	  FILE_LOG(logINFO) << "Maximin Latin hypercube sampling";
+	  maximinLhs(xPoints, mtRandom, seconds);
 	}
       else
 	{
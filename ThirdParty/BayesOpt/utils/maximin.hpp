@@ -0,0 +1,203 @@
+/** \file maximin.hpp \brief Space-filling (maximin) Latin hypercube designs. */
+/*
+-------------------------------------------------------------------------
+   This file is part of BayesOpt, an efficient C++ library for
+   Bayesian optimization.
+
+   Copyright (C) 2011-2015 Ruben Martinez-Cantin <rmcantin@unizar.es>
+
+   BayesOpt is free software: you can redistribute it and/or modify it
+   under the terms of the GNU Affero General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   BayesOpt is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with BayesOpt.  If not, see <http://www.gnu.org/licenses/>.
+------------------------------------------------------------------------
+*/
+
+#ifndef __MAXIMIN_HPP__
+#define __MAXIMIN_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <vector>
+#include "parallel.hpp"
+
+// It only depends on the standard library, so it can be included
+// without boost (e.g.: by the applications linking the dll).
+
+namespace bayesopt
+{
+  namespace utils
+  {
+    namespace detail
+    {
+      /** \brief d^-15 of the squared distance d (Morris-Mitchell
+       * criterion with p = 30) */
+      inline double maximinTerm(double d)
+      {
+	const double d2 = d*d, d4 = d2*d2, d8 = d4*d4;
+	return 1.0 / (d8*d4*d2*d);
+      }
+
+      /** \brief Simulated annealing of one chain. Returns the best
+       * design found, in cell units (X[k*n+i] is the cell of the i-th
+       * point in dimension k), and its criterion in score. */
+      inline std::vector<int> maximinChain(size_t n, size_t nDims,
+					   uint32_t seed, size_t maxIters,
+					   double seconds,
+					   std::chrono::steady_clock::time_point deadline,
+					   double& score)
+      {
+	std::mt19937 eng(seed);
+	std::uniform_real_distribution<double> sample(0.0,1.0);
+	std::uniform_int_distribution<size_t> row(0,n-1);
+	std::uniform_int_distribution<size_t> dim(0,nDims-1);
+
+	std::vector<int> X(n*nDims);
+	for (size_t k = 0; k < nDims; ++k)
+	  {
+	    for (size_t i = 0; i < n; ++i) X[k*n+i] = static_cast<int>(i);
+	    std::shuffle(X.begin() + k*n, X.begin() + (k+1)*n, eng);
+	  }
+
+	// Squared distances (exact in cell units) and criterion
+	std::vector<double> D(n*n, 0.0);
+	score = 0.0;
+	for (size_t i = 0; i < n; ++i)
+	  for (size_t j = 0; j < i; ++j)
+	    {
+	      double d = 0.0;
+	      for (size_t k = 0; k < nDims; ++k)
+		{
+		  const double dk = X[k*n+i] - X[k*n+j];
+		  d += dk*dk;
+		}
+	      D[i*n+j] = D[j*n+i] = d;
+	      score += maximinTerm(d);
+	    }
+
+	std::vector<int> best(X);
+	double bestScore = score;
+	std::vector<double> Di(n), Dj(n);
+
+	// Acceptance on the relative change of the criterion. The
+	// temperature decays geometrically along the iterations.
+	const double T0 = 0.05, T1 = 1e-4;
+	for (size_t it = 0; it < maxIters; ++it)
+	  {
+	    if ((seconds > 0.0) && ((it & 255) == 0) &&
+		(std::chrono::steady_clock::now() > deadline))
+	      break;
+
+	    const size_t k = dim(eng), i = row(eng);
+	    size_t j = row(eng);
+	    if (j == i) j = (i + 1) % n;
+
+	    int* Xk = &X[k*n];
+	    const double xi = Xk[i], xj = Xk[j];
+	    double delta = 0.0;
+	    for (size_t l = 0; l < n; ++l)
+	      {
+		if ((l == i) || (l == j)) continue;
+		const double xl = Xk[l];
+		const double ci = (xj-xl)*(xj-xl) - (xi-xl)*(xi-xl);
+		Di[l] = D[i*n+l] + ci;
+		Dj[l] = D[j*n+l] - ci;
+		delta += maximinTerm(Di[l]) - maximinTerm(D[i*n+l])
+		  + maximinTerm(Dj[l]) - maximinTerm(D[j*n+l]);
+	      }
+
+	    const double T = T0 * std::pow(T1/T0, double(it)/maxIters);
+	    if ((delta <= 0.0) || (sample(eng) < std::exp(-delta / (T*score))))
+	      {
+		std::swap(Xk[i],Xk[j]);
+		for (size_t l = 0; l < n; ++l)
+		  {
+		    if ((l == i) || (l == j)) continue;
+		    D[i*n+l] = D[l*n+i] = Di[l];
+		    D[j*n+l] = D[l*n+j] = Dj[l];
+		  }
+		score += delta;
+		if (score < bestScore)
+		  {
+		    bestScore = score;
+		    best = X;
+		  }
+	      }
+	  }
+	score = bestScore;
+	return best;
+      }
+    } //namespace detail
+
+    /**
+     * \brief Space-filling (maximin) Latin hypercube design in
+     * [0,1]^dims.
+     *
+     * Simulated annealing over swaps of two cells of a column, which
+     * keep the design a Latin hypercube, minimizing the Morris-Mitchell
+     * criterion, a smooth version of maximizing the minimum distance
+     * between points. Each swap only changes the distances of two
+     * points, so it is evaluated in O(n). Several chains run from
+     * different designs, and the best is written with the points at the
+     * center of their cells. Each chain has its own thread, so all of
+     * them start at once and get the same share of the budget even on
+     * machines with fewer hardware threads. The result only depends on
+     * the seed and, if the budget runs out, on the time.
+     *
+     * @param rows n rows of dims coordinates
+     * @param seed seed of the chains
+     * @param seconds wall clock budget of the annealing, 0 no limit
+     * @return Morris-Mitchell criterion of the design (p-th root)
+     */
+    inline double maximinLhsGenerate(double* const* rows, size_t n,
+				     size_t dims, uint32_t seed,
+				     double seconds)
+    {
+      typedef std::chrono::steady_clock Clock;
+      if ((n == 0) || (dims == 0)) return 0.0;
+
+      const Clock::time_point deadline = Clock::now() +
+	std::chrono::duration_cast<Clock::duration>(
+	  std::chrono::duration<double>(seconds));
+      const size_t maxIters = (n < 3) ? 0 : std::min(size_t(200000), 1000*n*dims);
+
+      const size_t nChains = (n < 3) ? 1 : 8;
+      std::seed_seq seq{seed};
+      std::vector<uint32_t> seeds(nChains);
+      seq.generate(seeds.begin(), seeds.end());
+
+      std::vector<std::vector<int> > cells(nChains);
+      std::vector<double> scores(nChains);
+      parallel_for(nChains, nChains, [&](size_t c, size_t)
+	{
+	  cells[c] = detail::maximinChain(n, dims, seeds[c], maxIters,
+					  seconds, deadline, scores[c]);
+	});
+
+      const size_t c = std::min_element(scores.begin(), scores.end())
+	- scores.begin();
+
+      const double nd = static_cast<double>(n);
+      for (size_t k = 0; k < dims; ++k)
+	for (size_t i = 0; i < n; ++i)
+	  rows[i][k] = (cells[c][k*n+i] + 0.5) / nd;
+
+      return std::pow(scores[c], 1.0/30.0);
+    }
+
+  } //namespace utils
+} //namespace bayesopt
+
+#endif
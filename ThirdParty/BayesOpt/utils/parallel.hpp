@@ -0,0 +1,83 @@
+/**  \file parallel.hpp \brief Simple parallel loops over index ranges. */
+/*
+-------------------------------------------------------------------------
+   This file is part of BayesOpt, an efficient C++ library for 
+   Bayesian optimization.
+
+   Copyright (C) 2011-2015 Ruben Martinez-Cantin <rmcantin@unizar.es>
+ 
+   BayesOpt is free software: you can redistribute it and/or modify it 
+   under the terms of the GNU Affero General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   BayesOpt is distributed in the hope that it will be useful, but 
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with BayesOpt.  If not, see <http://www.gnu.org/licenses/>.
+------------------------------------------------------------------------
+*/
+
+#ifndef __PARALLEL_HPP__
+#define __PARALLEL_HPP__
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+namespace bayesopt
+{
+  namespace utils
+  {
+    /** \brief Number of worker threads. If requested is zero, it
+     * returns the number of hardware threads. */
+    inline size_t numThreads(size_t requested)
+    {
+      if (requested > 0) return requested;
+      const size_t hw = std::thread::hardware_concurrency();
+      return (hw > 0) ? hw : 1;
+    }
+
+    /** 
+     * \brief Calls f(i,t) for every i in [0,n), where t in
+     * [0,nThreads) is the worker running that iteration.
+     *
+     * The range is split in contiguous chunks, one per worker, and the
+     * calling thread runs the first one. Thus, the worker of each
+     * iteration only depends on n and nThreads, and a worker never
+     * runs two iterations at the same time. Per-worker scratch can be
+     * indexed by t, and results written by i are reproducible.
+     */
+    template <class F>
+    void parallel_for(size_t n, size_t nThreads, F f)
+    {
+      nThreads = std::min(nThreads, n);
+      if (nThreads <= 1)
+	{
+	  for (size_t i = 0; i < n; ++i) f(i,0);
+	  return;
+	}
+
+      const size_t chunk = (n + nThreads - 1) / nThreads;
+      std::vector<std::thread> pool;
+      pool.reserve(nThreads-1);
+      for (size_t t = 1; t < nThreads; ++t)
+	{
+	  pool.push_back(std::thread([=,&f]() 
+	    {
+	      const size_t end = std::min(n, (t+1)*chunk);
+	      for (size_t i = t*chunk; i < end; ++i) f(i,t);
+	    }));
+	}
+
+      for (size_t i = 0; i < std::min(n, chunk); ++i) f(i,0);
+      for (size_t t = 0; t < pool.size(); ++t) pool[t].join();
+    }
+
+  } //namespace utils
+} //namespace bayesopt
+
+#endif